@@ -27,6 +27,7 @@
 #include "git2r_arg.h"
 #include "git2r_blame.h"
 #include "git2r_blob.h"
+#include "git2r_bloom.h"
 #include "git2r_branch.h"
 #include "git2r_checkout.h"
 #include "git2r_clone.h"
@@ -67,6 +68,7 @@ static const R_CallMethodDef callMethods[] =
     CALLDEF(git2r_blob_create_fromworkdir, 2),
     CALLDEF(git2r_blob_is_binary, 1),
     CALLDEF(git2r_blob_rawsize, 1),
+    CALLDEF(git2r_bloom_index_write, 1),
     CALLDEF(git2r_branch_canonical_name, 1),
     CALLDEF(git2r_branch_create, 3),
     CALLDEF(git2r_branch_delete, 1),
@@ -90,9 +92,16 @@ static const R_CallMethodDef callMethods[] =
     CALLDEF(git2r_config_get_logical, 2),
     CALLDEF(git2r_config_get_string, 2),
     CALLDEF(git2r_config_set, 2),
-    CALLDEF(git2r_diff, 12),
+    CALLDEF(git2r_diff, 13),
+    CALLDEF(git2r_diff_batch, 8),
+    CALLDEF(git2r_diff_cochange, 4),
+    CALLDEF(git2r_diff_numstat, 5),
+    CALLDEF(git2r_diff_pickaxe, 6),
     CALLDEF(git2r_graph_ahead_behind, 2),
+    CALLDEF(git2r_graph_ahead_behind_matrix, 3),
+    CALLDEF(git2r_graph_commit_graph_write, 1),
     CALLDEF(git2r_graph_descendant_of, 2),
+    CALLDEF(git2r_graph_reachable, 4),
     CALLDEF(git2r_index_add_all, 3),
     CALLDEF(git2r_index_remove_bypath, 2),
     CALLDEF(git2r_libgit2_features, 0),
@@ -122,6 +131,7 @@ static const R_CallMethodDef callMethods[] =
     CALLDEF(git2r_remote_url, 2),
     CALLDEF(git2r_remote_ls, 4),
     CALLDEF(git2r_repository_can_open, 1),
+    CALLDEF(git2r_repository_close, 1),
     CALLDEF(git2r_repository_discover, 2),
     CALLDEF(git2r_repository_fetch_heads, 1),
     CALLDEF(git2r_repository_head, 1),
@@ -136,9 +146,12 @@ static const R_CallMethodDef callMethods[] =
     CALLDEF(git2r_reset, 2),
     CALLDEF(git2r_reset_default, 2),
     CALLDEF(git2r_revparse_single, 2),
-    CALLDEF(git2r_revwalk_contributions, 4),
-    CALLDEF(git2r_revwalk_list, 6),
-    CALLDEF(git2r_revwalk_list2, 7),
+    CALLDEF(git2r_revwalk_contributions, 3),
+    CALLDEF(git2r_revwalk_df, 10),
+    CALLDEF(git2r_revwalk_list, 8),
+    CALLDEF(git2r_revwalk_list2, 10),
+    CALLDEF(git2r_revwalk_punch_card, 1),
+    CALLDEF(git2r_revwalk_tips, 4),
     CALLDEF(git2r_signature_default, 1),
     CALLDEF(git2r_ssl_cert_locations, 2),
     CALLDEF(git2r_stash_apply, 2),
@@ -180,5 +193,8 @@ void
 R_unload_git2r(DllInfo *info)
 {
     GIT2R_UNUSED(info);
+    git2r_repository_cache_clear();
+    git2r_graph_reachable_cache_clear();
+    git2r_bloom_index_cache_clear();
     git_libgit2_shutdown();
 }
@@ -47,6 +47,10 @@ const char *git2r_S3_class__git_diff = "git_diff";
 const char *git2r_S3_items__git_diff[] = {
     "old", "new", "files", ""};
 
+const char *git2r_S3_class__git_diff_columnar = "git_diff_columnar";
+const char *git2r_S3_items__git_diff_columnar[] = {
+    "old", "new", "files", "hunks", "lines", ""};
+
 const char *git2r_S3_class__git_diff_file = "git_diff_file";
 const char *git2r_S3_items__git_diff_file[] = {
     "old_file", "new_file", "hunks", ""};
@@ -59,6 +63,10 @@ const char *git2r_S3_class__git_diff_line = "git_diff_line";
 const char *git2r_S3_items__git_diff_line[] = {
     "origin", "old_lineno", "new_lineno", "num_lines", "content", ""};
 
+const char *git2r_S3_class__git_diff_stats = "git_diff_stats";
+const char *git2r_S3_items__git_diff_stats[] = {
+    "old", "new", "files_changed", "insertions", "deletions", "files", ""};
+
 const char *git2r_S3_class__git_fetch_head = "git_fetch_head";
 const char *git2r_S3_items__git_fetch_head[] = {
     "ref_name", "remote_url", "sha", "is_merge", "repo", ""};
@@ -73,6 +73,15 @@ enum {
     git2r_S3_item__git_diff__new,
     git2r_S3_item__git_diff__files};
 
+extern const char *git2r_S3_class__git_diff_columnar;
+extern const char *git2r_S3_items__git_diff_columnar[];
+enum {
+    git2r_S3_item__git_diff_columnar__old,
+    git2r_S3_item__git_diff_columnar__new,
+    git2r_S3_item__git_diff_columnar__files,
+    git2r_S3_item__git_diff_columnar__hunks,
+    git2r_S3_item__git_diff_columnar__lines};
+
 extern const char *git2r_S3_class__git_diff_file;
 extern const char *git2r_S3_items__git_diff_file[];
 enum {
@@ -99,6 +108,16 @@ enum {
     git2r_S3_item__git_diff_line__num_lines,
     git2r_S3_item__git_diff_line__content};
 
+extern const char *git2r_S3_class__git_diff_stats;
+extern const char *git2r_S3_items__git_diff_stats[];
+enum {
+    git2r_S3_item__git_diff_stats__old,
+    git2r_S3_item__git_diff_stats__new,
+    git2r_S3_item__git_diff_stats__files_changed,
+    git2r_S3_item__git_diff_stats__insertions,
+    git2r_S3_item__git_diff_stats__deletions,
+    git2r_S3_item__git_diff_stats__files};
+
 extern const char *git2r_S3_class__git_fetch_head;
 extern const char *git2r_S3_items__git_fetch_head[];
 enum {
@@ -228,6 +228,7 @@ git2r_arg_check_fetch_heads(
  *  - R_NilValue
  *  - Zero length character vector
  *  - character vector of length one with strlen(value) > 0
+ *  - function to stream the output to
  * @param arg the arg to check
  * @return 0 if OK, else -1
  */
@@ -235,7 +236,7 @@ int attribute_hidden
 git2r_arg_check_filename(
     SEXP arg)
 {
-    if (Rf_isNull(arg))
+    if (Rf_isNull(arg) || Rf_isFunction(arg))
         return 0;
     if (!Rf_isString(arg))
         return -1;
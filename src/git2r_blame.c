@@ -185,7 +185,7 @@ git2r_blame_file(
 
 cleanup:
     git_blame_free(blame);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
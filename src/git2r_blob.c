@@ -78,7 +78,7 @@ git2r_blob_content(
 
 cleanup:
     git_blob_free(blob_obj);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -144,7 +144,7 @@ git2r_blob_create_fromdisk(
     }
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -214,7 +214,7 @@ git2r_blob_create_fromworkdir(
     }
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -288,7 +288,7 @@ git2r_blob_is_binary(
 
 cleanup:
     git_blob_free(blob_obj);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -334,7 +334,7 @@ git2r_blob_rawsize(
 
 cleanup:
     git_blob_free(blob_obj);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -0,0 +1,822 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2026 The git2r contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2,
+ *  as published by the Free Software Foundation.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <R_ext/Visibility.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "git2r_bloom.h"
+#include "git2r_error.h"
+#include "git2r_repository.h"
+
+/**
+ * Index with a changed-path Bloom filter for each commit.
+ *
+ * The Bloom filter of a commit contains the paths that differ
+ * between the commit and its first parent, and the directories of
+ * these paths. A query for a path that is not in the filter means
+ * that the path is the same as in the first parent, so the commit
+ * cannot have modified the path and the trees do not need to be
+ * read.
+ *
+ * The index is stored in 'objects/info/git2r-changed-paths' with all
+ * numbers in network byte order:
+ *
+ *   4 bytes: Signature "G2RP"
+ *   4 bytes: Version, 1
+ *   4 bytes: Number of commits, n
+ *   n * 20 bytes: The sorted commit ids
+ *   (n + 1) * 4 bytes: Offsets of the filters in the filter data
+ *   The filter data
+ *
+ * A filter of length zero means that the commit changed too many
+ * paths to be useful, and every query gives "maybe".
+ *
+ * The index is shared with the cache, and freed when the last
+ * reference is released.
+ */
+struct git2r_bloom_index {
+    int refcount;
+    unsigned char *buf;
+    uint32_t n;
+    const unsigned char *oids;
+    const unsigned char *offsets;
+    const unsigned char *filters;
+    size_t filters_size;
+};
+
+#define GIT2R_BLOOM_SIGNATURE "G2RP"
+#define GIT2R_BLOOM_VERSION 1
+#define GIT2R_BLOOM_HEADER_SIZE 12
+#define GIT2R_BLOOM_BITS_PER_ENTRY 10
+#define GIT2R_BLOOM_NUM_HASHES 7
+#define GIT2R_BLOOM_MAX_CHANGED_PATHS 512
+
+/**
+ * Builder of the changed-path Bloom filter index.
+ */
+typedef struct {
+    git_oid oid;
+    size_t offset;
+    size_t len;
+} git2r_bloom_entry;
+
+typedef struct {
+    git2r_bloom_entry *entries;
+    size_t n;
+    size_t capacity;
+    unsigned char *data;
+    size_t size;
+    size_t data_capacity;
+} git2r_bloom_builder;
+
+static uint32_t
+git2r_bloom_get_u32(
+    const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+        ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void
+git2r_bloom_put_u32(
+    unsigned char *p,
+    uint32_t value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+/**
+ * The 32-bit MurmurHash3 of a string.
+ *
+ * @param seed The seed of the hash.
+ * @param data The string to hash.
+ * @param len The number of bytes in the string.
+ * @return The hash.
+ */
+static uint32_t
+git2r_bloom_murmur3(
+    uint32_t seed,
+    const char *data,
+    size_t len)
+{
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i, nblocks = len / 4;
+    uint32_t k, h = seed;
+
+    for (i = 0; i < nblocks; i++) {
+        k = (uint32_t)p[4 * i] |
+            ((uint32_t)p[4 * i + 1] << 8) |
+            ((uint32_t)p[4 * i + 2] << 16) |
+            ((uint32_t)p[4 * i + 3] << 24);
+        k *= c1;
+        k = (k << 15) | (k >> 17);
+        k *= c2;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+    }
+
+    k = 0;
+    p += 4 * nblocks;
+    switch (len & 3) {
+    case 3:
+        k ^= (uint32_t)p[2] << 16;
+        /* fallthrough */
+    case 2:
+        k ^= (uint32_t)p[1] << 8;
+        /* fallthrough */
+    case 1:
+        k ^= (uint32_t)p[0];
+        k *= c1;
+        k = (k << 15) | (k >> 17);
+        k *= c2;
+        h ^= k;
+    }
+
+    h ^= (uint32_t)len;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static void
+git2r_bloom_key_from_buffer(
+    git2r_bloom_key *key,
+    const char *path,
+    size_t len)
+{
+    key->h1 = git2r_bloom_murmur3(0x293ae76f, path, len);
+    key->h2 = git2r_bloom_murmur3(0x7e646e2c, path, len);
+}
+
+/**
+ * Init the key to query the Bloom filters for a path.
+ *
+ * @param key The key to initialize.
+ * @param path The path relative to the root of the repository. A
+ * trailing '/' of a directory is ignored.
+ * @return void
+ */
+void attribute_hidden
+git2r_bloom_key_init(
+    git2r_bloom_key *key,
+    const char *path)
+{
+    size_t len = strlen(path);
+
+    while (len && path[len - 1] == '/')
+        len--;
+    git2r_bloom_key_from_buffer(key, path, len);
+}
+
+static void
+git2r_bloom_filter_set(
+    unsigned char *filter,
+    size_t len,
+    const git2r_bloom_key *key)
+{
+    uint32_t i, nbits = (uint32_t)(8 * len);
+
+    for (i = 0; i < GIT2R_BLOOM_NUM_HASHES; i++) {
+        uint32_t pos = (key->h1 + i * key->h2) % nbits;
+        filter[pos >> 3] |= (unsigned char)(1 << (pos & 7));
+    }
+}
+
+static int
+git2r_bloom_filter_test(
+    const unsigned char *filter,
+    size_t len,
+    const git2r_bloom_key *key)
+{
+    uint32_t i, nbits = (uint32_t)(8 * len);
+
+    for (i = 0; i < GIT2R_BLOOM_NUM_HASHES; i++) {
+        uint32_t pos = (key->h1 + i * key->h2) % nbits;
+        if (!(filter[pos >> 3] & (1 << (pos & 7))))
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * The path to the changed-path Bloom filter index.
+ *
+ * @param repository The repository.
+ * @return A newly allocated string that must be freed by the
+ * caller, or NULL if the memory could not be allocated.
+ */
+static char *
+git2r_bloom_index_path(
+    git_repository *repository)
+{
+    const char *commondir = git_repository_commondir(repository);
+    const char *filename = "objects/info/git2r-changed-paths";
+    char *path = malloc(strlen(commondir) + strlen(filename) + 1);
+
+    if (path) {
+        strcpy(path, commondir);
+        strcat(path, filename);
+    }
+
+    return path;
+}
+
+/**
+ * The last loaded index, saved between calls until the file changes.
+ */
+static struct {
+    char *path;
+    time_t mtime;
+    off_t size;
+    git2r_bloom_index *index;
+} git2r_bloom_cache = {NULL, 0, 0, NULL};
+
+/**
+ * Release the saved index.
+ *
+ * @return void
+ */
+void attribute_hidden
+git2r_bloom_index_cache_clear(void)
+{
+    git2r_bloom_index_free(git2r_bloom_cache.index);
+    free(git2r_bloom_cache.path);
+    git2r_bloom_cache.path = NULL;
+    git2r_bloom_cache.index = NULL;
+}
+
+/**
+ * Load the changed-path Bloom filter index of a repository.
+ *
+ * The index is only read again if the path, the modification time
+ * or the size of the file differs from the last loaded index.
+ *
+ * @param out The loaded index, or NULL if the repository has no
+ * index or the index is invalid. Free with git2r_bloom_index_free.
+ * @param repository The repository.
+ * @return 0 on success, or an error code.
+ */
+int attribute_hidden
+git2r_bloom_index_load(
+    git2r_bloom_index **out,
+    git_repository *repository)
+{
+    int error = GIT_OK;
+    char *path = NULL;
+    FILE *file = NULL;
+    long size;
+    size_t table_size;
+    uint32_t n;
+    struct stat sb;
+    git2r_bloom_index *index = NULL;
+
+    *out = NULL;
+
+    path = git2r_bloom_index_path(repository);
+    if (!path)
+        goto alloc_error;
+
+    if (stat(path, &sb)) {
+        if (git2r_bloom_cache.path && !strcmp(git2r_bloom_cache.path, path))
+            git2r_bloom_index_cache_clear();
+        goto cleanup;
+    }
+
+    if (git2r_bloom_cache.path && !strcmp(git2r_bloom_cache.path, path)) {
+        if (git2r_bloom_cache.mtime == sb.st_mtime &&
+            git2r_bloom_cache.size == sb.st_size) {
+            git2r_bloom_cache.index->refcount++;
+            *out = git2r_bloom_cache.index;
+            goto cleanup;
+        }
+        git2r_bloom_index_cache_clear();
+    }
+
+    file = fopen(path, "rb");
+    if (!file)
+        goto cleanup;
+    if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET))
+        goto cleanup;
+    if (size < GIT2R_BLOOM_HEADER_SIZE)
+        goto cleanup;
+
+    index = calloc(1, sizeof(git2r_bloom_index));
+    if (!index)
+        goto alloc_error;
+    index->refcount = 1;
+    index->buf = malloc((size_t)size);
+    if (!index->buf)
+        goto alloc_error;
+    if (fread(index->buf, 1, (size_t)size, file) != (size_t)size)
+        goto cleanup;
+
+    if (memcmp(index->buf, GIT2R_BLOOM_SIGNATURE, 4) ||
+        git2r_bloom_get_u32(index->buf + 4) != GIT2R_BLOOM_VERSION)
+        goto cleanup;
+
+    n = git2r_bloom_get_u32(index->buf + 8);
+    table_size = (size_t)n * GIT_OID_RAWSZ + ((size_t)n + 1) * 4;
+    if ((size_t)size - GIT2R_BLOOM_HEADER_SIZE < table_size)
+        goto cleanup;
+
+    index->n = n;
+    index->oids = index->buf + GIT2R_BLOOM_HEADER_SIZE;
+    index->offsets = index->oids + (size_t)n * GIT_OID_RAWSZ;
+    index->filters = index->offsets + ((size_t)n + 1) * 4;
+    index->filters_size = (size_t)size - GIT2R_BLOOM_HEADER_SIZE - table_size;
+
+    /* Save the index, and hand the path over to the cache. */
+    git2r_bloom_index_cache_clear();
+    git2r_bloom_cache.path = path;
+    git2r_bloom_cache.mtime = sb.st_mtime;
+    git2r_bloom_cache.size = sb.st_size;
+    git2r_bloom_cache.index = index;
+    index->refcount++;
+    path = NULL;
+
+    *out = index;
+    index = NULL;
+    goto cleanup;
+
+alloc_error:
+    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+    error = GIT_ERROR;
+
+cleanup:
+    git2r_bloom_index_free(index);
+    if (file)
+        fclose(file);
+    free(path);
+
+    return error;
+}
+
+/**
+ * Release a changed-path Bloom filter index. The index is freed when
+ * it is no longer referenced by the cache.
+ *
+ * @param index The index to release.
+ * @return void
+ */
+void attribute_hidden
+git2r_bloom_index_free(
+    git2r_bloom_index *index)
+{
+    if (index && --index->refcount == 0) {
+        free(index->buf);
+        free(index);
+    }
+}
+
+/**
+ * Find the Bloom filter of a commit in the index.
+ *
+ * @param filter The filter of the commit.
+ * @param len The length of the filter.
+ * @param index The index.
+ * @param oid The id of the commit.
+ * @return 1 if the commit is in the index, else 0.
+ */
+static int
+git2r_bloom_index_find(
+    const unsigned char **filter,
+    size_t *len,
+    const git2r_bloom_index *index,
+    const git_oid *oid)
+{
+    size_t lo = 0, hi = index->n;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(oid->id, index->oids + mid * GIT_OID_RAWSZ,
+                         GIT_OID_RAWSZ);
+
+        if (cmp == 0) {
+            size_t start = git2r_bloom_get_u32(index->offsets + 4 * mid);
+            size_t end = git2r_bloom_get_u32(index->offsets + 4 * (mid + 1));
+
+            if (start > end || end > index->filters_size)
+                return 0;
+            *filter = index->filters + start;
+            *len = end - start;
+            return 1;
+        }
+
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Check if a commit may have modified a path, compared to its first
+ * parent.
+ *
+ * @param index The index, or NULL if the repository has no index.
+ * @param oid The id of the commit.
+ * @param key The key of the path.
+ * @return 0 if the commit did not modify the path, or 1 if the
+ * commit may have modified the path.
+ */
+int attribute_hidden
+git2r_bloom_index_maybe(
+    const git2r_bloom_index *index,
+    const git_oid *oid,
+    const git2r_bloom_key *key)
+{
+    const unsigned char *filter;
+    size_t len;
+
+    if (!index || !git2r_bloom_index_find(&filter, &len, index, oid))
+        return 1;
+
+    /* Too many changed paths. */
+    if (!len)
+        return 1;
+
+    return git2r_bloom_filter_test(filter, len, key);
+}
+
+/**
+ * Add a commit and its filter to the builder.
+ *
+ * @param builder The builder.
+ * @param oid The id of the commit.
+ * @param filter The filter of the commit.
+ * @param len The length of the filter.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_bloom_builder_add(
+    git2r_bloom_builder *builder,
+    const git_oid *oid,
+    const unsigned char *filter,
+    size_t len)
+{
+    if (builder->n == builder->capacity) {
+        size_t capacity = builder->capacity ? 2 * builder->capacity : 64;
+        git2r_bloom_entry *entries = realloc(
+            builder->entries, capacity * sizeof(git2r_bloom_entry));
+
+        if (!entries)
+            goto alloc_error;
+        builder->entries = entries;
+        builder->capacity = capacity;
+    }
+
+    if (builder->size + len > builder->data_capacity) {
+        size_t capacity = builder->data_capacity ? builder->data_capacity : 4096;
+        unsigned char *data;
+
+        while (builder->size + len > capacity)
+            capacity *= 2;
+        data = realloc(builder->data, capacity);
+        if (!data)
+            goto alloc_error;
+        builder->data = data;
+        builder->data_capacity = capacity;
+    }
+
+    git_oid_cpy(&(builder->entries[builder->n].oid), oid);
+    builder->entries[builder->n].offset = builder->size;
+    builder->entries[builder->n].len = len;
+    builder->n++;
+    if (len)
+        memcpy(builder->data + builder->size, filter, len);
+    builder->size += len;
+
+    return GIT_OK;
+
+alloc_error:
+    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+    return GIT_ERROR;
+}
+
+/**
+ * Compute the Bloom filter of the paths that differ between a
+ * commit and its first parent, and add it to the builder.
+ *
+ * A merge commit is only compared to the first parent. Since a
+ * merge that did not modify a path compared to one of its parents
+ * is not a "touching" commit, "not in the filter" is still enough
+ * to skip the commit.
+ *
+ * @param builder The builder.
+ * @param commit The commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_bloom_builder_add_commit(
+    git2r_bloom_builder *builder,
+    git_commit *commit)
+{
+    int error;
+    size_t i, n, n_keys = 0, len = 0;
+    unsigned char *filter = NULL;
+    git_commit *parent = NULL;
+    git_tree *parent_tree = NULL, *tree = NULL;
+    git_diff *diff = NULL;
+
+    if (git_commit_parentcount(commit)) {
+        if ((error = git_commit_parent(&parent, commit, 0)) < 0)
+            goto cleanup;
+        if ((error = git_commit_tree(&parent_tree, parent)) < 0)
+            goto cleanup;
+    }
+    if ((error = git_commit_tree(&tree, commit)) < 0)
+        goto cleanup;
+
+    error = git_diff_tree_to_tree(
+        &diff, git_commit_owner(commit), parent_tree, tree, NULL);
+    if (error)
+        goto cleanup;
+
+    /* Count the changed paths and their directories. */
+    n = git_diff_num_deltas(diff);
+    for (i = 0; i < n; i++) {
+        const char *p = git_diff_get_delta(diff, i)->new_file.path;
+
+        n_keys++;
+        for (; *p; p++) {
+            if (*p == '/')
+                n_keys++;
+        }
+    }
+
+    if (n_keys <= GIT2R_BLOOM_MAX_CHANGED_PATHS) {
+        len = (n_keys * GIT2R_BLOOM_BITS_PER_ENTRY + 7) / 8;
+        if (!len)
+            len = 1;
+        filter = calloc(len, 1);
+        if (!filter) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            error = GIT_ERROR;
+            goto cleanup;
+        }
+
+        for (i = 0; i < n; i++) {
+            const char *path = git_diff_get_delta(diff, i)->new_file.path;
+            const char *p;
+            git2r_bloom_key key;
+
+            git2r_bloom_key_from_buffer(&key, path, strlen(path));
+            git2r_bloom_filter_set(filter, len, &key);
+            for (p = path; *p; p++) {
+                if (*p == '/') {
+                    git2r_bloom_key_from_buffer(&key, path, (size_t)(p - path));
+                    git2r_bloom_filter_set(filter, len, &key);
+                }
+            }
+        }
+    }
+
+    error = git2r_bloom_builder_add(builder, git_commit_id(commit), filter, len);
+
+cleanup:
+    free(filter);
+    git_diff_free(diff);
+    git_tree_free(tree);
+    git_tree_free(parent_tree);
+    git_commit_free(parent);
+
+    return error;
+}
+
+static int
+git2r_bloom_entry_cmp(
+    const void *a,
+    const void *b)
+{
+    return git_oid_cmp(&((const git2r_bloom_entry *)a)->oid,
+                       &((const git2r_bloom_entry *)b)->oid);
+}
+
+/**
+ * Write the index with the filters in the builder to a file.
+ *
+ * The index is first written to a lock file that is renamed when
+ * the index is complete.
+ *
+ * @param builder The builder.
+ * @param path The path to the index.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_bloom_builder_write(
+    git2r_bloom_builder *builder,
+    const char *path)
+{
+    int error = GIT_OK;
+    char *lock = NULL;
+    FILE *file = NULL;
+    size_t i;
+    uint32_t offset = 0;
+    unsigned char buf[GIT2R_BLOOM_HEADER_SIZE];
+
+    if (builder->n)
+        qsort(builder->entries, builder->n, sizeof(git2r_bloom_entry),
+              git2r_bloom_entry_cmp);
+
+    lock = malloc(strlen(path) + strlen(".lock") + 1);
+    if (!lock) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+    strcpy(lock, path);
+    strcat(lock, ".lock");
+
+    file = fopen(lock, "wb");
+    if (!file)
+        goto write_error;
+
+    memcpy(buf, GIT2R_BLOOM_SIGNATURE, 4);
+    git2r_bloom_put_u32(buf + 4, GIT2R_BLOOM_VERSION);
+    git2r_bloom_put_u32(buf + 8, (uint32_t)builder->n);
+    if (fwrite(buf, 1, GIT2R_BLOOM_HEADER_SIZE, file) != GIT2R_BLOOM_HEADER_SIZE)
+        goto write_error;
+
+    for (i = 0; i < builder->n; i++) {
+        if (fwrite(builder->entries[i].oid.id, 1, GIT_OID_RAWSZ, file) !=
+            GIT_OID_RAWSZ)
+            goto write_error;
+    }
+
+    for (i = 0; i <= builder->n; i++) {
+        git2r_bloom_put_u32(buf, offset);
+        if (fwrite(buf, 1, 4, file) != 4)
+            goto write_error;
+        if (i < builder->n)
+            offset += (uint32_t)builder->entries[i].len;
+    }
+
+    for (i = 0; i < builder->n; i++) {
+        size_t len = builder->entries[i].len;
+
+        if (len && fwrite(builder->data + builder->entries[i].offset,
+                          1, len, file) != len)
+            goto write_error;
+    }
+
+    error = fclose(file);
+    file = NULL;
+    if (error)
+        goto write_error;
+
+    remove(path);
+    if (rename(lock, path))
+        goto write_error;
+
+    goto cleanup;
+
+write_error:
+    giterr_set_str(GIT_ERROR_OS, git2r_err_bloom_index_write);
+    error = GIT_ERROR;
+    if (file)
+        fclose(file);
+    remove(lock);
+
+cleanup:
+    free(lock);
+
+    return error;
+}
+
+/**
+ * Write the changed-path Bloom filter index for the commits
+ * reachable from the references and HEAD in the repository.
+ *
+ * The filters of the commits that are already in an existing index
+ * are reused, so updating the index after new commits only computes
+ * the filters of the new commits.
+ *
+ * @param repo S3 class git_repository
+ * @return The path to the index, or R_NilValue if the repository is
+ * empty.
+ */
+SEXP attribute_hidden
+git2r_bloom_index_write(
+    SEXP repo)
+{
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    char *path = NULL;
+    git_oid oid;
+    git2r_bloom_builder builder = {NULL, 0, 0, NULL, 0, 0};
+    git2r_bloom_index *index = NULL;
+    git_revwalk *walker = NULL;
+    git_repository *repository = NULL;
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    if (git_repository_is_empty(repository))
+        goto cleanup;
+
+    path = git2r_bloom_index_path(repository);
+    if (!path) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    error = git2r_bloom_index_load(&index, repository);
+    if (error)
+        goto cleanup;
+
+    error = git_revwalk_new(&walker, repository);
+    if (error)
+        goto cleanup;
+    error = git_revwalk_push_glob(walker, "refs/*");
+    if (error)
+        goto cleanup;
+    if (!git_repository_head_unborn(repository)) {
+        error = git_revwalk_push_head(walker);
+        if (error)
+            goto cleanup;
+    }
+
+    while (!(error = git_revwalk_next(&oid, walker))) {
+        const unsigned char *filter;
+        size_t len;
+
+        if (index && git2r_bloom_index_find(&filter, &len, index, &oid)) {
+            error = git2r_bloom_builder_add(&builder, &oid, filter, len);
+        } else {
+            git_commit *commit;
+
+            error = git_commit_lookup(&commit, repository, &oid);
+            if (error)
+                goto cleanup;
+            error = git2r_bloom_builder_add_commit(&builder, commit);
+            git_commit_free(commit);
+        }
+
+        if (error)
+            goto cleanup;
+    }
+
+    if (GIT_ITEROVER != error)
+        goto cleanup;
+
+    error = git2r_bloom_builder_write(&builder, path);
+    if (error)
+        goto cleanup;
+
+    /* Read the new index on the next query, even if it has the same
+     * size and modification time as the old one. */
+    if (git2r_bloom_cache.path && !strcmp(git2r_bloom_cache.path, path))
+        git2r_bloom_index_cache_clear();
+
+    PROTECT(result = Rf_mkString(path));
+    nprotect++;
+
+cleanup:
+    free(builder.entries);
+    free(builder.data);
+    git2r_bloom_index_free(index);
+    git_revwalk_free(walker);
+    free(path);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
@@ -0,0 +1,44 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2026 The git2r contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2,
+ *  as published by the Free Software Foundation.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INCLUDE_git2r_bloom_h
+#define INCLUDE_git2r_bloom_h
+
+#include <R.h>
+#include <Rinternals.h>
+#include <git2.h>
+#include <stdint.h>
+
+typedef struct git2r_bloom_index git2r_bloom_index;
+
+/**
+ * The hashes of a path to query the changed-path Bloom filters.
+ */
+typedef struct {
+    uint32_t h1;
+    uint32_t h2;
+} git2r_bloom_key;
+
+int git2r_bloom_index_load(git2r_bloom_index **out, git_repository *repository);
+void git2r_bloom_index_free(git2r_bloom_index *index);
+void git2r_bloom_index_cache_clear(void);
+void git2r_bloom_key_init(git2r_bloom_key *key, const char *path);
+int git2r_bloom_index_maybe(const git2r_bloom_index *index, const git_oid *oid, const git2r_bloom_key *key);
+SEXP git2r_bloom_index_write(SEXP repo);
+
+#endif
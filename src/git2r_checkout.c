@@ -76,7 +76,7 @@ git2r_checkout_path(
 
 cleanup:
     free(opts.paths.strings);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -141,7 +141,7 @@ git2r_checkout_tree(
 
 cleanup:
     git_object_free(treeish);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -20,48 +20,71 @@
 #include "git2r_arg.h"
 #include "git2r_diff.h"
 #include "git2r_error.h"
+#include "git2r_oidmap.h"
 #include "git2r_repository.h"
 #include "git2r_S3.h"
+#include "git2r_thread.h"
 #include "git2r_tree.h"
 
 #include <git2.h>
 #include <git2/sys/diff.h>
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-static int
-git2r_diff_count(
-    git_diff *diff, size_t *num_files,
-    size_t *max_hunks, size_t *max_lines);
-
 static int
 git2r_diff_format_to_r(
     git_diff *diff,
     SEXP dest);
 
+/**
+ * The formats of a diff as an R object.
+ */
+enum {
+    GIT2R_DIFF_FORMAT_GIT_DIFF,
+    GIT2R_DIFF_FORMAT_COLUMNAR,
+    GIT2R_DIFF_FORMAT_STATS,
+    GIT2R_DIFF_FORMAT_NAME_STATUS};
+
+static const char *git2r_diff_formats[] = {
+    "git_diff", "columnar", "stats", "name_status", ""};
+
+/**
+ * A table of columns that grow while a diff is formatted.
+ */
+typedef struct {
+    SEXP columns;
+    R_xlen_t n;
+    R_xlen_t capacity;
+} git2r_diff_table;
+
 SEXP git2r_diff_index_to_wd(
     SEXP repo,
     SEXP filename,
+    int format,
     git_diff_options *opts);
 
 SEXP
 git2r_diff_head_to_index(
     SEXP repo,
     SEXP filename,
+    int format,
     git_diff_options *opts);
 
 SEXP
 git2r_diff_tree_to_wd(
     SEXP tree,
     SEXP filename,
+    int format,
     git_diff_options *opts);
 
 SEXP
 git2r_diff_tree_to_index(
     SEXP tree,
     SEXP filename,
+    int format,
     git_diff_options *opts);
 
 SEXP
@@ -69,6 +92,7 @@ git2r_diff_tree_to_tree(
     SEXP tree1,
     SEXP tree2,
     SEXP filename,
+    int format,
     git_diff_options *opts);
 
 /**
@@ -115,8 +139,16 @@ git2r_diff_tree_to_tree(
  * @param max_size A size (in bytes) above which a blob will be
  * marked as binary automatically; pass a negative value to
  * disable. Defaults to 512MB when max_size is NULL.
- * @return A S3 class git_diff object if filename equals R_NilValue. A
- * character vector with diff if filename has length 0. Oterwise NULL.
+ * @param format The format of the R object when filename is
+ * R_NilValue: "git_diff" for a S3 class git_diff object,
+ * "columnar" for a S3 class git_diff_columnar object with a files, a
+ * hunks and a lines table, "stats" for a S3 class git_diff_stats
+ * object with the number of added and deleted lines, or
+ * "name_status" for a data.frame with the status of each changed
+ * file.
+ * @return A S3 class git_diff, git_diff_columnar or git_diff_stats
+ * object, or a data.frame, if filename equals R_NilValue. A character vector with diff if
+ * filename has length 0. Oterwise NULL.
  */
 SEXP attribute_hidden
 git2r_diff(
@@ -131,11 +163,26 @@ git2r_diff(
     SEXP new_prefix,
     SEXP id_abbrev,
     SEXP path,
-    SEXP max_size)
+    SEXP max_size,
+    SEXP format)
 {
-    int c_index;
+    int c_index, c_format;
     git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
 
+    if (git2r_arg_check_string(format))
+        git2r_error(__func__, NULL, "'format'", git2r_err_string_arg);
+    for (c_format = 0; git2r_diff_formats[c_format][0]; c_format++) {
+        if (!strcmp(git2r_diff_formats[c_format], CHAR(STRING_ELT(format, 0))))
+            break;
+    }
+    if (!git2r_diff_formats[c_format][0])
+        git2r_error(__func__, NULL, "'format'", git2r_err_diff_format_arg);
+
+    /* The name-status is read from the deltas only. The format is
+     * not used when the patch is written as text. */
+    if (c_format == GIT2R_DIFF_FORMAT_NAME_STATUS && Rf_isNull(filename))
+        opts.flags |= GIT_DIFF_SKIP_BINARY_CHECK;
+
     if (git2r_arg_check_logical(index))
         git2r_error(__func__, NULL, "'index'", git2r_err_logical_arg);
     c_index = LOGICAL(index)[0];
@@ -185,40 +232,150 @@ git2r_diff(
     if (Rf_isNull(tree1) && ! c_index) {
 	if (!Rf_isNull(tree2))
 	    git2r_error(__func__, NULL, git2r_err_diff_arg, NULL);
-	return git2r_diff_index_to_wd(repo, filename, &opts);
+	return git2r_diff_index_to_wd(repo, filename, c_format, &opts);
     }
 
     if (Rf_isNull(tree1) && c_index) {
 	if (!Rf_isNull(tree2))
 	    git2r_error(__func__, NULL, git2r_err_diff_arg, NULL);
-	return git2r_diff_head_to_index(repo, filename, &opts);
+	return git2r_diff_head_to_index(repo, filename, c_format, &opts);
     }
 
     if (!Rf_isNull(tree1) && Rf_isNull(tree2) && !c_index) {
 	if (!Rf_isNull(repo))
 	    git2r_error(__func__, NULL, git2r_err_diff_arg, NULL);
-	return git2r_diff_tree_to_wd(tree1, filename, &opts);
+	return git2r_diff_tree_to_wd(tree1, filename, c_format, &opts);
     }
 
     if (!Rf_isNull(tree1) && Rf_isNull(tree2) && c_index) {
 	if (!Rf_isNull(repo))
 	    git2r_error(__func__, NULL, git2r_err_diff_arg, NULL);
-	return git2r_diff_tree_to_index(tree1, filename, &opts);
+	return git2r_diff_tree_to_index(tree1, filename, c_format, &opts);
     }
 
     if (!Rf_isNull(repo))
         git2r_error(__func__, NULL, git2r_err_diff_arg, NULL);
-    return git2r_diff_tree_to_tree(tree1, tree2, filename, &opts);
+    return git2r_diff_tree_to_tree(tree1, tree2, filename, c_format, &opts);
+}
+
+/**
+ * The size of the output buffer of the patch writer.
+ */
+#define GIT2R_DIFF_WRITER_BUFSIZE (1024 * 1024)
+
+/**
+ * Buffered writer of a patch to a file or to an R function. The
+ * patch is written in chunks of GIT2R_DIFF_WRITER_BUFSIZE bytes, so
+ * the memory is constant and there is one write for each chunk
+ * instead of one for each line.
+ */
+typedef struct {
+    char *buf;
+    size_t len;
+    FILE *fp;
+    SEXP fun;
+} git2r_diff_writer;
+
+/**
+ * Write the buffered output to the file, or call the R function with
+ * the buffered output as a raw vector.
+ *
+ * @param writer The writer.
+ * @return 0 if OK, else -1
+ */
+static int
+git2r_diff_writer_flush(
+    git2r_diff_writer *writer)
+{
+    if (!writer->len)
+        return 0;
+
+    if (writer->fp) {
+        if (fwrite(writer->buf, 1, writer->len, writer->fp) != writer->len) {
+            giterr_set_str(GIT_ERROR_OS, git2r_err_diff_write);
+            return -1;
+        }
+    } else {
+        int error = 0;
+        SEXP chunk, call;
+
+        PROTECT(chunk = Rf_allocVector(RAWSXP, writer->len));
+        memcpy(RAW(chunk), writer->buf, writer->len);
+        PROTECT(call = Rf_lang2(writer->fun, chunk));
+        R_tryEvalSilent(call, R_GlobalEnv, &error);
+        UNPROTECT(2);
+        if (error) {
+            char buf[1024];
+            size_t len;
+
+            /* Keep the cause, e.g. a closed connection or a full
+             * disk, from the R error message. */
+            snprintf(buf, sizeof(buf), "%s: %s", git2r_err_diff_write,
+                     R_curErrorBuf());
+            len = strlen(buf);
+            while (len && (buf[len - 1] == '\n' || buf[len - 1] == ' '))
+                buf[--len] = '\0';
+            giterr_set_str(GIT_ERROR_NONE, buf);
+            return -1;
+        }
+    }
+
+    writer->len = 0;
+
+    return 0;
+}
+
+/**
+ * Append data to the output buffer, and flush the buffer when it's
+ * full.
+ *
+ * @param writer The writer.
+ * @param data The data to write.
+ * @param len The number of bytes to write.
+ * @return 0 if OK, else -1
+ */
+static int
+git2r_diff_writer_write(
+    git2r_diff_writer *writer,
+    const char *data,
+    size_t len)
+{
+    while (len) {
+        size_t n = GIT2R_DIFF_WRITER_BUFSIZE - writer->len;
+
+        if (n > len)
+            n = len;
+        memcpy(writer->buf + writer->len, data, n);
+        writer->len += n;
+        data += n;
+        len -= n;
+
+        if (writer->len == GIT2R_DIFF_WRITER_BUFSIZE &&
+            git2r_diff_writer_flush(writer))
+            return -1;
+    }
+
+    return 0;
 }
 
+/**
+ * Callback per line of the patch, to write the line with its origin.
+ *
+ * @param delta A pointer to the delta data for the file
+ * @param hunk A pointer to the structure describing a hunk of a diff
+ * @param line A pointer to the structure describing a line (or data
+ * span) of a diff.
+ * @param payload A pointer to the git2r_diff_writer
+ * @return 0 if OK, else -1
+ */
 static int
-git2r_diff_print_cb(
+git2r_diff_writer_cb(
     const git_diff_delta *delta,
     const git_diff_hunk *hunk,
     const git_diff_line *line,
     void *payload)
 {
-    int error;
+    git2r_diff_writer *writer = payload;
 
     GIT2R_UNUSED(delta);
     GIT2R_UNUSED(hunk);
@@ -226,230 +383,797 @@ git2r_diff_print_cb(
     if (line->origin == GIT_DIFF_LINE_CONTEXT ||
         line->origin == GIT_DIFF_LINE_ADDITION ||
         line->origin == GIT_DIFF_LINE_DELETION) {
-        while ((error = fputc(line->origin, (FILE *)payload)) == EINTR)
-            continue;
-        if (error == EOF)
+        char origin = line->origin;
+
+        if (git2r_diff_writer_write(writer, &origin, 1))
             return -1;
     }
 
-    if (fwrite(line->content, line->content_len, 1, (FILE *)payload) != 1)
-        return -1;
-
-    return 0;
+    return git2r_diff_writer_write(writer, line->content, line->content_len);
 }
 
 /**
- * Create a diff between the repository index and the workdir
- * directory.
+ * Stream a patch to a file or to an R function.
  *
- * @param repo S3 class git_repository
- * @param filename Determines where to write the diff. If filename is
- * R_NilValue, then the diff is written to a S3 class git_diff
- * object. If filename is a character vector of length 0, then the
- * diff is written to a character vector. If filename is a character
- * vector of length one with non-NA value, the diff is written to a
- * file with name filename (the file is overwritten if it exists).
- * @param opts Structure describing options about how the diff
- * should be executed.
- * @return A S3 class git_diff object if filename equals R_NilValue. A
- * character vector with diff if filename has length 0. Oterwise NULL.
+ * @param diff The diff.
+ * @param filename The name of the file, or an R function that is
+ * called with each chunk of the patch as a raw vector.
+ * @return 0 if OK, else error code
  */
-SEXP attribute_hidden
-git2r_diff_index_to_wd(
-    SEXP repo,
-    SEXP filename,
-    git_diff_options *opts)
+static int
+git2r_diff_write_patch(
+    git_diff *diff,
+    SEXP filename)
 {
-    int error, nprotect = 0;
-    git_repository *repository = NULL;
-    git_diff *diff = NULL;
-    SEXP result = R_NilValue;
+    int error;
+    git2r_diff_writer writer = {NULL, 0, NULL, R_NilValue};
 
-    if (git2r_arg_check_filename(filename))
-        git2r_error(__func__, NULL, "'filename'", git2r_err_filename_arg);
+    writer.buf = malloc(GIT2R_DIFF_WRITER_BUFSIZE);
+    if (!writer.buf) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
 
-    repository = git2r_repository_open(repo);
-    if (!repository)
-        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+    if (Rf_isFunction(filename)) {
+        writer.fun = filename;
+    } else {
+        writer.fp = fopen(CHAR(STRING_ELT(filename, 0)), "w+");
+        if (!writer.fp) {
+            free(writer.buf);
+            giterr_set_str(GIT_ERROR_OS, strerror(errno));
+            return GIT_ERROR;
+        }
 
-    error = git_diff_index_to_workdir(&diff,
-                                      repository,
-                                      /*index=*/ NULL,
-                                      opts);
+        /* The output is already buffered. */
+        setvbuf(writer.fp, NULL, _IONBF, 0);
+    }
 
-    if (error)
-	goto cleanup;
+    error = git_diff_print(
+        diff,
+        GIT_DIFF_FORMAT_PATCH,
+        git2r_diff_writer_cb,
+        &writer);
+    if (!error)
+        error = git2r_diff_writer_flush(&writer);
+
+    if (writer.fp && fclose(writer.fp) && !error) {
+        giterr_set_str(GIT_ERROR_OS, git2r_err_diff_write);
+        error = GIT_ERROR;
+    }
+    free(writer.buf);
 
-    if (Rf_isNull(filename)) {
-        PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff));
-        nprotect++;
-        Rf_setAttrib(result, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_diff));
+    return error;
+}
 
-        SET_VECTOR_ELT(result, git2r_S3_item__git_diff__old, Rf_mkString("index"));
+/**
+ * The name of the status of a delta.
+ *
+ * @param status The status.
+ * @return The name of the status.
+ */
+static const char *
+git2r_diff_status_name(
+    git_delta_t status)
+{
+    switch (status) {
+    case GIT_DELTA_ADDED:
+        return "added";
+    case GIT_DELTA_DELETED:
+        return "deleted";
+    case GIT_DELTA_MODIFIED:
+        return "modified";
+    case GIT_DELTA_RENAMED:
+        return "renamed";
+    case GIT_DELTA_COPIED:
+        return "copied";
+    case GIT_DELTA_TYPECHANGE:
+        return "typechange";
+    case GIT_DELTA_UNMODIFIED:
+        return "unmodified";
+    default:
+        return "unknown";
+    }
+}
 
-        SET_VECTOR_ELT(result, git2r_S3_item__git_diff__new, Rf_mkString("workdir"));
+/**
+ * Grow the columns of a table to hold n more rows.
+ *
+ * @param table The table.
+ * @param n The number of rows to add.
+ * @return void
+ */
+static void
+git2r_diff_table_reserve(
+    git2r_diff_table *table,
+    R_xlen_t n)
+{
+    R_xlen_t i, capacity = table->capacity;
 
-        error = git2r_diff_format_to_r(diff, result);
-    } else if (0 == Rf_length(filename)) {
-        git_buf buf = GIT_BUF_INIT_CONST(NULL, 0);
+    if (table->n + n <= capacity)
+        return;
 
-        error = git_diff_to_buf(&buf, diff, GIT_DIFF_FORMAT_PATCH);
-        if (!error) {
-            PROTECT(result = Rf_mkString(buf.ptr));
-            nprotect++;
-        }
+    while (capacity < table->n + n)
+        capacity *= 2;
+    for (i = 0; i < Rf_xlength(table->columns); i++) {
+        SET_VECTOR_ELT(table->columns, i,
+                       Rf_xlengthgets(VECTOR_ELT(table->columns, i), capacity));
+    }
+    table->capacity = capacity;
+}
 
-        git_buf_dispose(&buf);
-    } else {
-        FILE *fp = fopen(CHAR(STRING_ELT(filename, 0)), "w+");
+/**
+ * Create the columns of a table.
+ *
+ * @param table The table.
+ * @param names The names of the columns, terminated by "".
+ * @param types The types of the columns.
+ * @return The list with the columns, unprotected.
+ */
+static SEXP
+git2r_diff_table_init(
+    git2r_diff_table *table,
+    const char **names,
+    const SEXPTYPE *types)
+{
+    size_t i, n = 0;
+    SEXP colnames;
+
+    while (names[n][0])
+        n++;
+
+    PROTECT(table->columns = Rf_allocVector(VECSXP, n));
+    Rf_setAttrib(table->columns, R_NamesSymbol,
+                 colnames = Rf_allocVector(STRSXP, n));
+    for (i = 0; i < n; i++) {
+        SET_STRING_ELT(colnames, i, Rf_mkChar(names[i]));
+        SET_VECTOR_ELT(table->columns, i, Rf_allocVector(types[i], 256));
+    }
+    table->n = 0;
+    table->capacity = 256;
+    UNPROTECT(1);
+
+    return table->columns;
+}
 
-        error = git_diff_print(
-            diff,
-            GIT_DIFF_FORMAT_PATCH,
-            git2r_diff_print_cb,
-            fp);
+/**
+ * Shrink the columns of a table to the number of rows and make it a
+ * data.frame.
+ *
+ * @param table The table.
+ * @return void
+ */
+static void
+git2r_diff_table_finish(
+    git2r_diff_table *table)
+{
+    R_xlen_t i;
+    SEXP row_names;
 
-        if (fp)
-            fclose(fp);
+    for (i = 0; i < Rf_xlength(table->columns); i++) {
+        SET_VECTOR_ELT(table->columns, i,
+                       Rf_xlengthgets(VECTOR_ELT(table->columns, i), table->n));
     }
 
-cleanup:
-    free(opts->pathspec.strings);
-    git_diff_free(diff);
-    git_repository_free(repository);
+    /* The compact form of the row names, as '.set_row_names()'. */
+    if (table->n) {
+        PROTECT(row_names = Rf_allocVector(INTSXP, 2));
+        INTEGER(row_names)[0] = NA_INTEGER;
+        INTEGER(row_names)[1] = -(int)table->n;
+    } else {
+        PROTECT(row_names = Rf_allocVector(INTSXP, 0));
+    }
+    Rf_setAttrib(table->columns, R_RowNamesSymbol, row_names);
+    Rf_setAttrib(table->columns, R_ClassSymbol, Rf_mkString("data.frame"));
+    UNPROTECT(1);
+}
 
-    if (nprotect)
-        UNPROTECT(nprotect);
+/**
+ * Columns of the files, hunks and lines tables of a columnar diff.
+ */
+static const char *git2r_diff_file_columns[] = {
+    "old_file", "new_file", "status", ""};
+static const SEXPTYPE git2r_diff_file_types[] = {
+    STRSXP, STRSXP, STRSXP};
+enum {
+    git2r_diff_file__old_file,
+    git2r_diff_file__new_file,
+    git2r_diff_file__status};
+
+static const char *git2r_diff_hunk_columns[] = {
+    "file", "old_start", "old_lines", "new_start", "new_lines", "header", ""};
+static const SEXPTYPE git2r_diff_hunk_types[] = {
+    INTSXP, INTSXP, INTSXP, INTSXP, INTSXP, STRSXP};
+enum {
+    git2r_diff_hunk__file,
+    git2r_diff_hunk__old_start,
+    git2r_diff_hunk__old_lines,
+    git2r_diff_hunk__new_start,
+    git2r_diff_hunk__new_lines,
+    git2r_diff_hunk__header};
+
+static const char *git2r_diff_line_columns[] = {
+    "file", "hunk", "origin", "old_lineno", "new_lineno", "num_lines",
+    "content", ""};
+static const SEXPTYPE git2r_diff_line_types[] = {
+    INTSXP, INTSXP, INTSXP, INTSXP, INTSXP, INTSXP, STRSXP};
+enum {
+    git2r_diff_line__file,
+    git2r_diff_line__hunk,
+    git2r_diff_line__origin,
+    git2r_diff_line__old_lineno,
+    git2r_diff_line__new_lineno,
+    git2r_diff_line__num_lines,
+    git2r_diff_line__content};
 
-    if (error)
-        git2r_error(__func__, git_error_last(), NULL, NULL);
+/**
+ * Append the hunks and lines of the patch of a file to the hunks and
+ * lines tables of a columnar diff.
+ *
+ * @param hunks The hunks table.
+ * @param lines The lines table.
+ * @param patch The patch of the file.
+ * @param file The one-based index of the file in the files table.
+ * @return 0 if OK, else error code
+ */
+static int
+git2r_diff_patch_to_columns(
+    git2r_diff_table *hunks,
+    git2r_diff_table *lines,
+    git_patch *patch,
+    int file)
+{
+    int error = GIT_OK;
+    size_t i, j, n_hunks = git_patch_num_hunks(patch);
+
+    git2r_diff_table_reserve(hunks, (R_xlen_t)n_hunks);
+    for (i = 0; i < n_hunks; i++) {
+        const git_diff_hunk *hunk;
+        size_t n_lines;
+        int *file_no, *hunk_no, *origin, *old_lineno, *new_lineno, *num_lines;
+        SEXP content;
+
+        error = git_patch_get_hunk(&hunk, &n_lines, patch, i);
+        if (error)
+            break;
+
+        INTEGER(VECTOR_ELT(hunks->columns, git2r_diff_hunk__file))[hunks->n] =
+            file;
+        INTEGER(VECTOR_ELT(hunks->columns, git2r_diff_hunk__old_start))[hunks->n] =
+            hunk->old_start;
+        INTEGER(VECTOR_ELT(hunks->columns, git2r_diff_hunk__old_lines))[hunks->n] =
+            hunk->old_lines;
+        INTEGER(VECTOR_ELT(hunks->columns, git2r_diff_hunk__new_start))[hunks->n] =
+            hunk->new_start;
+        INTEGER(VECTOR_ELT(hunks->columns, git2r_diff_hunk__new_lines))[hunks->n] =
+            hunk->new_lines;
+        SET_STRING_ELT(VECTOR_ELT(hunks->columns, git2r_diff_hunk__header),
+                       hunks->n, Rf_mkChar(hunk->header));
+        hunks->n++;
+
+        git2r_diff_table_reserve(lines, (R_xlen_t)n_lines);
+        file_no = INTEGER(VECTOR_ELT(lines->columns, git2r_diff_line__file));
+        hunk_no = INTEGER(VECTOR_ELT(lines->columns, git2r_diff_line__hunk));
+        origin = INTEGER(VECTOR_ELT(lines->columns, git2r_diff_line__origin));
+        old_lineno = INTEGER(VECTOR_ELT(lines->columns, git2r_diff_line__old_lineno));
+        new_lineno = INTEGER(VECTOR_ELT(lines->columns, git2r_diff_line__new_lineno));
+        num_lines = INTEGER(VECTOR_ELT(lines->columns, git2r_diff_line__num_lines));
+        content = VECTOR_ELT(lines->columns, git2r_diff_line__content);
+
+        for (j = 0; j < n_lines; j++) {
+            const git_diff_line *line;
+            const char *nul;
+            size_t len;
+
+            error = git_patch_get_line_in_hunk(&line, patch, i, j);
+            if (error)
+                break;
+
+            /* Stop at an embedded nul, as with the git_diff_line
+             * objects. */
+            nul = memchr(line->content, 0, line->content_len);
+            len = nul ? (size_t)(nul - line->content) : line->content_len;
+
+            file_no[lines->n] = file;
+            hunk_no[lines->n] = (int)hunks->n;
+            origin[lines->n] = line->origin;
+            old_lineno[lines->n] = line->old_lineno;
+            new_lineno[lines->n] = line->new_lineno;
+            num_lines[lines->n] = line->num_lines;
+            SET_STRING_ELT(content, lines->n,
+                           Rf_mkCharLen(line->content, (int)len));
+            lines->n++;
+        }
 
-    return result;
+        if (error)
+            break;
+    }
+
+    return error;
 }
 
 /**
- * Create a diff between head and repository index
+ * Format a diff as a files, a hunks and a lines table.
  *
- * @param repo S3 class git_repository
- * @param filename Determines where to write the diff. If filename is
- * R_NilValue, then the diff is written to a S3 class git_diff
- * object. If filename is a character vector of length 0, then the
- * diff is written to a character vector. If filename is a character
- * vector of length one with non-NA value, the diff is written to a
- * file with name filename (the file is overwritten if it exists).
- * @param opts Structure describing options about how the diff
- * should be executed.
- * @return A S3 class git_diff object if filename equals R_NilValue. A
- * character vector with diff if filename has length 0. Oterwise NULL.
+ * The patch of each file is generated once, and the rows are
+ * appended to columns that grow geometrically, so a large diff
+ * costs a few allocations per column and one string for each line,
+ * instead of one S3 object for each line and hunk.
+ *
+ * @param diff Pointer to the diff
+ * @param dest The S3 class git_diff_columnar to hold the formated
+ * diff
+ * @return 0 if OK, else error code
  */
-SEXP attribute_hidden
-git2r_diff_head_to_index(
-    SEXP repo,
-    SEXP filename,
-    git_diff_options *opts)
+static int
+git2r_diff_format_to_columns(
+    git_diff *diff,
+    SEXP dest)
 {
-    int error, nprotect = 0;
-    git_repository *repository = NULL;
-    git_diff *diff = NULL;
-    git_object *obj = NULL;
-    git_tree *head = NULL;
-    SEXP result = R_NilValue;
-
-    if (git2r_arg_check_filename(filename))
-        git2r_error(__func__, NULL, "'filename'", git2r_err_filename_arg);
+    int error = GIT_OK;
+    size_t i, n_deltas = git_diff_num_deltas(diff);
+    git2r_diff_table files, hunks, lines;
+
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_columnar__files,
+                   git2r_diff_table_init(&files, git2r_diff_file_columns,
+                                         git2r_diff_file_types));
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_columnar__hunks,
+                   git2r_diff_table_init(&hunks, git2r_diff_hunk_columns,
+                                         git2r_diff_hunk_types));
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_columnar__lines,
+                   git2r_diff_table_init(&lines, git2r_diff_line_columns,
+                                         git2r_diff_line_types));
+
+    for (i = 0; !error && i < n_deltas; i++) {
+        git_patch *patch = NULL;
+        const git_diff_delta *delta;
+
+        error = git_patch_from_diff(&patch, diff, i);
+        if (error)
+            break;
+
+        delta = patch ? git_patch_get_delta(patch) : git_diff_get_delta(diff, i);
+        git2r_diff_table_reserve(&files, 1);
+        SET_STRING_ELT(VECTOR_ELT(files.columns, git2r_diff_file__old_file),
+                       files.n, Rf_mkChar(delta->old_file.path));
+        SET_STRING_ELT(VECTOR_ELT(files.columns, git2r_diff_file__new_file),
+                       files.n, Rf_mkChar(delta->new_file.path));
+        SET_STRING_ELT(VECTOR_ELT(files.columns, git2r_diff_file__status),
+                       files.n, Rf_mkChar(git2r_diff_status_name(delta->status)));
+        files.n++;
+
+        if (patch)
+            error = git2r_diff_patch_to_columns(&hunks, &lines, patch, (int)files.n);
+
+        git_patch_free(patch);
+    }
 
-    repository = git2r_repository_open(repo);
-    if (!repository)
-        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+    git2r_diff_table_finish(&files);
+    git2r_diff_table_finish(&hunks);
+    git2r_diff_table_finish(&lines);
 
-    error = git_revparse_single(&obj, repository, "HEAD^{tree}");
-    if (error)
-	goto cleanup;
+    return error;
+}
 
-    error = git_tree_lookup(&head, repository, git_object_id(obj));
-    if (error)
-	goto cleanup;
+static const char *git2r_diff_stats_columns[] = {
+    "old_file", "new_file", "status", "additions", "deletions", ""};
+static const SEXPTYPE git2r_diff_stats_types[] = {
+    STRSXP, STRSXP, STRSXP, INTSXP, INTSXP};
+enum {
+    git2r_diff_stats__old_file,
+    git2r_diff_stats__new_file,
+    git2r_diff_stats__status,
+    git2r_diff_stats__additions,
+    git2r_diff_stats__deletions};
 
-    error = git_diff_tree_to_index(
-        &diff,
-        repository,
-        head,
-        /* index= */ NULL,
-        opts);
-    if (error)
-	goto cleanup;
+/**
+ * Format the statistics of a diff, as with 'git diff --numstat', and
+ * the totals, as with git_diff_get_stats.
+ *
+ * The lines of each patch are only counted, so no git_diff_line
+ * object is created and no line content is copied. The totals are
+ * summed from the files, since git_diff_get_stats would generate the
+ * patches a second time.
+ *
+ * @param diff Pointer to the diff
+ * @param dest The S3 class git_diff_stats to hold the statistics
+ * @return 0 if OK, else error code
+ */
+static int
+git2r_diff_format_to_stats(
+    git_diff *diff,
+    SEXP dest)
+{
+    int error = GIT_OK;
+    size_t i, n_deltas = git_diff_num_deltas(diff);
+    size_t insertions = 0, deletions = 0;
+    git2r_diff_table files;
+
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_stats__files,
+                   git2r_diff_table_init(&files, git2r_diff_stats_columns,
+                                         git2r_diff_stats_types));
+    git2r_diff_table_reserve(&files, (R_xlen_t)n_deltas);
+
+    for (i = 0; i < n_deltas; i++) {
+        git_patch *patch = NULL;
+        const git_diff_delta *delta;
+        size_t additions = 0, removals = 0;
+        int binary;
+
+        error = git_patch_from_diff(&patch, diff, i);
+        if (error)
+            break;
+
+        /* The binary flag of the delta is set by the patch. */
+        delta = patch ? git_patch_get_delta(patch) : git_diff_get_delta(diff, i);
+        binary = delta->flags & GIT_DIFF_FLAG_BINARY;
+        if (patch && !binary)
+            error = git_patch_line_stats(NULL, &additions, &removals, patch);
+        if (error) {
+            git_patch_free(patch);
+            break;
+        }
 
-    if (Rf_isNull(filename)) {
-        /* TODO: object instead of HEAD string */
-        PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff));
-        nprotect++;
-        Rf_setAttrib(result, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_diff));
+        SET_STRING_ELT(VECTOR_ELT(files.columns, git2r_diff_stats__old_file),
+                       files.n, Rf_mkChar(delta->old_file.path));
+        SET_STRING_ELT(VECTOR_ELT(files.columns, git2r_diff_stats__new_file),
+                       files.n, Rf_mkChar(delta->new_file.path));
+        SET_STRING_ELT(VECTOR_ELT(files.columns, git2r_diff_stats__status),
+                       files.n, Rf_mkChar(git2r_diff_status_name(delta->status)));
+        INTEGER(VECTOR_ELT(files.columns, git2r_diff_stats__additions))[files.n] =
+            binary ? NA_INTEGER : (int)additions;
+        INTEGER(VECTOR_ELT(files.columns, git2r_diff_stats__deletions))[files.n] =
+            binary ? NA_INTEGER : (int)removals;
+        files.n++;
+        git_patch_free(patch);
+
+        insertions += additions;
+        deletions += removals;
+    }
 
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__old,
-            Rf_mkString("HEAD"));
+    git2r_diff_table_finish(&files);
 
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__new,
-            Rf_mkString("index"));
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_stats__files_changed,
+                   Rf_ScalarInteger((int)n_deltas));
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_stats__insertions,
+                   Rf_ScalarInteger((int)insertions));
+    SET_VECTOR_ELT(dest, git2r_S3_item__git_diff_stats__deletions,
+                   Rf_ScalarInteger((int)deletions));
 
-        error = git2r_diff_format_to_r(diff, result);
-    } else if (0 == Rf_length(filename)) {
-        git_buf buf = GIT_BUF_INIT_CONST(NULL, 0);
+    return error;
+}
 
-        error = git_diff_to_buf(
-            &buf,
-            diff,
-            GIT_DIFF_FORMAT_PATCH);
-        if (!error) {
-            PROTECT(result = Rf_mkString(buf.ptr));
-            nprotect++;
-        }
+static const char *git2r_diff_name_status_columns[] = {
+    "old_path", "new_path", "status", "old_oid", "new_oid", "old_mode",
+    "new_mode", ""};
+static const SEXPTYPE git2r_diff_name_status_types[] = {
+    STRSXP, STRSXP, STRSXP, STRSXP, STRSXP, STRSXP, STRSXP};
+enum {
+    git2r_diff_name_status__old_path,
+    git2r_diff_name_status__new_path,
+    git2r_diff_name_status__status,
+    git2r_diff_name_status__old_oid,
+    git2r_diff_name_status__new_oid,
+    git2r_diff_name_status__old_mode,
+    git2r_diff_name_status__new_mode};
 
-        git_buf_dispose(&buf);
+/**
+ * Format the id and the mode of one side of a delta.
+ *
+ * @param file The side of the delta.
+ * @param oid The column with the ids.
+ * @param mode The column with the modes.
+ * @param i The row.
+ * @return void
+ */
+static void
+git2r_diff_name_status_file(
+    const git_diff_file *file,
+    SEXP oid,
+    SEXP mode,
+    R_xlen_t i)
+{
+    if (git_oid_is_zero(&(file->id))) {
+        SET_STRING_ELT(oid, i, NA_STRING);
     } else {
-        FILE *fp = fopen(CHAR(STRING_ELT(filename, 0)), "w+");
+        char sha[GIT_OID_HEXSZ + 1];
 
-        error = git_diff_print(
-            diff,
-            GIT_DIFF_FORMAT_PATCH,
-            git_diff_print_callback__to_file_handle,
-            fp);
-
-        if (fp)
-            fclose(fp);
+        git_oid_tostr(sha, sizeof(sha), &(file->id));
+        SET_STRING_ELT(oid, i, Rf_mkChar(sha));
     }
 
-cleanup:
-    free(opts->pathspec.strings);
-    git_tree_free(head);
-    git_object_free(obj);
-    git_diff_free(diff);
-    git_repository_free(repository);
-
-    if (nprotect)
-        UNPROTECT(nprotect);
-
-    if (error)
-        git2r_error(__func__, git_error_last(), NULL, NULL);
+    if (file->mode) {
+        char buf[23];
 
-    return result;
+        snprintf(buf, sizeof(buf), "%06o", (unsigned int)file->mode);
+        SET_STRING_ELT(mode, i, Rf_mkChar(buf));
+    } else {
+        SET_STRING_ELT(mode, i, NA_STRING);
+    }
 }
 
 /**
- * Create a diff between a tree and the working directory
+ * Format the status of each changed file, as with 'git diff
+ * --name-status'.
  *
- * @param tree S3 class git_tree
+ * Only the deltas are read, so no blob is loaded and no patch is
+ * generated. Renamed files are detected from identical blob ids
+ * only, since scoring the similarity of files reads the blobs.
+ *
+ * @param out The data.frame, unprotected.
+ * @param diff Pointer to the diff
+ * @return 0 if OK, else error code
+ */
+static int
+git2r_diff_format_to_name_status(
+    SEXP *out,
+    git_diff *diff)
+{
+    int error;
+    size_t i, n_deltas;
+    git_diff_find_options findopts = GIT_DIFF_FIND_OPTIONS_INIT;
+    git2r_diff_table table;
+    SEXP result;
+
+    findopts.flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_EXACT_MATCH_ONLY;
+    error = git_diff_find_similar(diff, &findopts);
+    if (error)
+        return error;
+
+    PROTECT(result = git2r_diff_table_init(&table, git2r_diff_name_status_columns,
+                                           git2r_diff_name_status_types));
+    n_deltas = git_diff_num_deltas(diff);
+    git2r_diff_table_reserve(&table, (R_xlen_t)n_deltas);
+
+    for (i = 0; i < n_deltas; i++) {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+        char status[2] = {0, 0};
+
+        status[0] = git_diff_status_char(delta->status);
+        SET_STRING_ELT(VECTOR_ELT(result, git2r_diff_name_status__old_path),
+                       table.n, Rf_mkChar(delta->old_file.path));
+        SET_STRING_ELT(VECTOR_ELT(result, git2r_diff_name_status__new_path),
+                       table.n, Rf_mkChar(delta->new_file.path));
+        SET_STRING_ELT(VECTOR_ELT(result, git2r_diff_name_status__status),
+                       table.n, Rf_mkChar(status));
+        git2r_diff_name_status_file(
+            &(delta->old_file),
+            VECTOR_ELT(result, git2r_diff_name_status__old_oid),
+            VECTOR_ELT(result, git2r_diff_name_status__old_mode),
+            table.n);
+        git2r_diff_name_status_file(
+            &(delta->new_file),
+            VECTOR_ELT(result, git2r_diff_name_status__new_oid),
+            VECTOR_ELT(result, git2r_diff_name_status__new_mode),
+            table.n);
+        table.n++;
+    }
+
+    git2r_diff_table_finish(&table);
+    *out = result;
+    UNPROTECT(1);
+
+    return GIT_OK;
+}
+
+/**
+ * Write a diff to the destination selected by filename and format.
+ *
+ * @param out The R object with the diff, or R_NilValue if the diff
+ * is written to a file. The object is not protected.
+ * @param diff The diff.
  * @param filename Determines where to write the diff. If filename is
- * R_NilValue, then the diff is written to a S3 class git_diff
- * object. If filename is a character vector of length 0, then the
+ * R_NilValue, then the diff is written to an R object in the
+ * format. If filename is a character vector of length 0, then the
  * diff is written to a character vector. If filename is a character
  * vector of length one with non-NA value, the diff is written to a
- * file with name filename (the file is overwritten if it exists).
+ * file with name filename (the file is overwritten if it exists). If
+ * filename is a function, the diff is streamed to the function in
+ * chunks, as raw vectors.
+ * @param format The format of the R object.
+ * @param old The old side of the diff, an S3 class git_tree or a
+ * description, e.g. "index".
+ * @param new The new side of the diff.
+ * @return 0 if OK, else error code
+ */
+static int
+git2r_diff_result(
+    SEXP *out,
+    git_diff *diff,
+    SEXP filename,
+    int format,
+    SEXP old,
+    SEXP new)
+{
+    int error = GIT_OK;
+    SEXP result = R_NilValue;
+
+    if (Rf_isNull(filename) && format == GIT2R_DIFF_FORMAT_NAME_STATUS) {
+        error = git2r_diff_format_to_name_status(&result, diff);
+    } else if (Rf_isNull(filename)) {
+        if (format == GIT2R_DIFF_FORMAT_COLUMNAR) {
+            PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_columnar));
+            Rf_setAttrib(result, R_ClassSymbol,
+                         Rf_mkString(git2r_S3_class__git_diff_columnar));
+            SET_VECTOR_ELT(result, git2r_S3_item__git_diff_columnar__old, old);
+            SET_VECTOR_ELT(result, git2r_S3_item__git_diff_columnar__new, new);
+            error = git2r_diff_format_to_columns(diff, result);
+        } else if (format == GIT2R_DIFF_FORMAT_STATS) {
+            PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_stats));
+            Rf_setAttrib(result, R_ClassSymbol,
+                         Rf_mkString(git2r_S3_class__git_diff_stats));
+            SET_VECTOR_ELT(result, git2r_S3_item__git_diff_stats__old, old);
+            SET_VECTOR_ELT(result, git2r_S3_item__git_diff_stats__new, new);
+            error = git2r_diff_format_to_stats(diff, result);
+        } else {
+            PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff));
+            Rf_setAttrib(result, R_ClassSymbol,
+                         Rf_mkString(git2r_S3_class__git_diff));
+            SET_VECTOR_ELT(result, git2r_S3_item__git_diff__old, old);
+            SET_VECTOR_ELT(result, git2r_S3_item__git_diff__new, new);
+            error = git2r_diff_format_to_r(diff, result);
+        }
+        UNPROTECT(1);
+    } else if (!Rf_isFunction(filename) && 0 == Rf_length(filename)) {
+        git_buf buf = GIT_BUF_INIT_CONST(NULL, 0);
+
+        error = git_diff_to_buf(&buf, diff, GIT_DIFF_FORMAT_PATCH);
+        if (!error)
+            result = Rf_mkString(buf.ptr);
+
+        git_buf_dispose(&buf);
+    } else {
+        error = git2r_diff_write_patch(diff, filename);
+    }
+
+    *out = result;
+
+    return error;
+}
+
+/**
+ * Create a diff between the repository index and the workdir
+ * directory.
+ *
+ * @param repo S3 class git_repository
+ * @param filename Determines where to write the diff, see
+ * git2r_diff_result.
+ * @param format The format of the R object.
+ * @param opts Structure describing options about how the diff
+ * should be executed.
+ * @return A S3 class git_diff object if filename equals R_NilValue. A
+ * character vector with diff if filename has length 0. Oterwise NULL.
+ */
+SEXP attribute_hidden
+git2r_diff_index_to_wd(
+    SEXP repo,
+    SEXP filename,
+    int format,
+    git_diff_options *opts)
+{
+    int error, nprotect = 0;
+    git_repository *repository = NULL;
+    git_diff *diff = NULL;
+    SEXP result = R_NilValue, old, new;
+
+    if (git2r_arg_check_filename(filename))
+        git2r_error(__func__, NULL, "'filename'", git2r_err_filename_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    error = git_diff_index_to_workdir(&diff,
+                                      repository,
+                                      /*index=*/ NULL,
+                                      opts);
+
+    if (error)
+	goto cleanup;
+
+    PROTECT(old = Rf_mkString("index"));
+    nprotect++;
+    PROTECT(new = Rf_mkString("workdir"));
+    nprotect++;
+    error = git2r_diff_result(&result, diff, filename, format, old, new);
+    PROTECT(result);
+    nprotect++;
+
+cleanup:
+    free(opts->pathspec.strings);
+    git_diff_free(diff);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Create a diff between head and repository index
+ *
+ * @param repo S3 class git_repository
+ * @param filename Determines where to write the diff, see
+ * git2r_diff_result.
+ * @param format The format of the R object.
+ * @param opts Structure describing options about how the diff
+ * should be executed.
+ * @return A S3 class git_diff object if filename equals R_NilValue. A
+ * character vector with diff if filename has length 0. Oterwise NULL.
+ */
+SEXP attribute_hidden
+git2r_diff_head_to_index(
+    SEXP repo,
+    SEXP filename,
+    int format,
+    git_diff_options *opts)
+{
+    int error, nprotect = 0;
+    git_repository *repository = NULL;
+    git_diff *diff = NULL;
+    git_object *obj = NULL;
+    git_tree *head = NULL;
+    SEXP result = R_NilValue, old, new;
+
+    if (git2r_arg_check_filename(filename))
+        git2r_error(__func__, NULL, "'filename'", git2r_err_filename_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    error = git_revparse_single(&obj, repository, "HEAD^{tree}");
+    if (error)
+	goto cleanup;
+
+    error = git_tree_lookup(&head, repository, git_object_id(obj));
+    if (error)
+	goto cleanup;
+
+    error = git_diff_tree_to_index(
+        &diff,
+        repository,
+        head,
+        /* index= */ NULL,
+        opts);
+    if (error)
+	goto cleanup;
+
+    /* TODO: object instead of HEAD string */
+    PROTECT(old = Rf_mkString("HEAD"));
+    nprotect++;
+    PROTECT(new = Rf_mkString("index"));
+    nprotect++;
+    error = git2r_diff_result(&result, diff, filename, format, old, new);
+    PROTECT(result);
+    nprotect++;
+
+cleanup:
+    free(opts->pathspec.strings);
+    git_tree_free(head);
+    git_object_free(obj);
+    git_diff_free(diff);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Create a diff between a tree and the working directory
+ *
+ * @param tree S3 class git_tree
+ * @param filename Determines where to write the diff, see
+ * git2r_diff_result.
+ * @param format The format of the R object.
  * @param opts Structure describing options about how the diff
  * should be executed.
  * @return A S3 class git_diff object if filename equals R_NilValue. A
@@ -459,6 +1183,7 @@ SEXP attribute_hidden
 git2r_diff_tree_to_wd(
     SEXP tree,
     SEXP filename,
+    int format,
     git_diff_options *opts)
 {
     int error, nprotect = 0;
@@ -467,7 +1192,7 @@ git2r_diff_tree_to_wd(
     git_object *obj = NULL;
     git_tree *c_tree = NULL;
     SEXP sha;
-    SEXP result = R_NilValue;
+    SEXP result = R_NilValue, new;
     SEXP repo;
 
     if (git2r_arg_check_tree(tree))
@@ -493,55 +1218,18 @@ git2r_diff_tree_to_wd(
     if (error)
 	goto cleanup;
 
-    if (Rf_isNull(filename)) {
-        PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff));
-        nprotect++;
-        Rf_setAttrib(result, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_diff));
-
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__old,
-            tree);
-
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__new,
-            Rf_mkString("workdir"));
-
-        error = git2r_diff_format_to_r(diff, result);
-    } else if (0 == Rf_length(filename)) {
-        git_buf buf = GIT_BUF_INIT_CONST(NULL, 0);
-
-        error = git_diff_to_buf(
-            &buf,
-            diff,
-            GIT_DIFF_FORMAT_PATCH);
-        if (!error) {
-            PROTECT(result = Rf_mkString(buf.ptr));
-            nprotect++;
-        }
-
-        git_buf_dispose(&buf);
-    } else {
-        FILE *fp = fopen(CHAR(STRING_ELT(filename, 0)), "w+");
-
-        error = git_diff_print(
-            diff,
-            GIT_DIFF_FORMAT_PATCH,
-            git_diff_print_callback__to_file_handle,
-            fp);
-
-        if (fp)
-            fclose(fp);
-    }
+    PROTECT(new = Rf_mkString("workdir"));
+    nprotect++;
+    error = git2r_diff_result(&result, diff, filename, format, tree, new);
+    PROTECT(result);
+    nprotect++;
 
 cleanup:
     free(opts->pathspec.strings);
     git_diff_free(diff);
     git_tree_free(c_tree);
     git_object_free(obj);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -556,12 +1244,9 @@ cleanup:
  * Create a diff between a tree and repository index
  *
  * @param tree S3 class git_tree
- * @param filename Determines where to write the diff. If filename is
- * R_NilValue, then the diff is written to a S3 class git_diff
- * object. If filename is a character vector of length 0, then the
- * diff is written to a character vector. If filename is a character
- * vector of length one with non-NA value, the diff is written to a
- * file with name filename (the file is overwritten if it exists).
+ * @param filename Determines where to write the diff, see
+ * git2r_diff_result.
+ * @param format The format of the R object.
  * @param opts Structure describing options about how the diff
  * should be executed.
  * @return A S3 class git_diff object if filename equals R_NilValue. A
@@ -571,6 +1256,7 @@ SEXP attribute_hidden
 git2r_diff_tree_to_index(
     SEXP tree,
     SEXP filename,
+    int format,
     git_diff_options *opts)
 {
     int error, nprotect = 0;
@@ -579,7 +1265,7 @@ git2r_diff_tree_to_index(
     git_object *obj = NULL;
     git_tree *c_tree = NULL;
     SEXP sha;
-    SEXP result = R_NilValue;
+    SEXP result = R_NilValue, new;
     SEXP repo;
 
     if (git2r_arg_check_tree(tree))
@@ -610,55 +1296,18 @@ git2r_diff_tree_to_index(
     if (error)
 	goto cleanup;
 
-    if (Rf_isNull(filename)) {
-        PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff));
-        nprotect++;
-        Rf_setAttrib(result, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_diff));
-
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__old,
-            tree);
-
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__new,
-            Rf_mkString("index"));
-
-        error = git2r_diff_format_to_r(diff, result);
-    } else if (0 == Rf_length(filename)) {
-        git_buf buf = GIT_BUF_INIT_CONST(NULL, 0);
-
-        error = git_diff_to_buf(
-            &buf,
-            diff,
-            GIT_DIFF_FORMAT_PATCH);
-        if (!error) {
-            PROTECT(result = Rf_mkString(buf.ptr));
-            nprotect++;
-        }
-
-        git_buf_dispose(&buf);
-    } else {
-        FILE *fp = fopen(CHAR(STRING_ELT(filename, 0)), "w+");
-
-        error = git_diff_print(
-            diff,
-            GIT_DIFF_FORMAT_PATCH,
-            git_diff_print_callback__to_file_handle,
-            fp);
-
-        if (fp)
-            fclose(fp);
-    }
+    PROTECT(new = Rf_mkString("index"));
+    nprotect++;
+    error = git2r_diff_result(&result, diff, filename, format, tree, new);
+    PROTECT(result);
+    nprotect++;
 
 cleanup:
     free(opts->pathspec.strings);
     git_diff_free(diff);
     git_tree_free(c_tree);
     git_object_free(obj);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -674,12 +1323,9 @@ cleanup:
  *
  * @param tree1 S3 class git_tree
  * @param tree2 S3 class git_tree
- * @param filename Determines where to write the diff. If filename is
- * R_NilValue, then the diff is written to a S3 class git_diff
- * object. If filename is a character vector of length 0, then the
- * diff is written to a character vector. If filename is a character
- * vector of length one with non-NA value, the diff is written to a
- * file with name filename (the file is overwritten if it exists).
+ * @param filename Determines where to write the diff, see
+ * git2r_diff_result.
+ * @param format The format of the R object.
  * @param opts Structure describing options about how the diff
  * should be executed.
  * @return A S3 class git_diff object if filename equals R_NilValue. A
@@ -690,6 +1336,7 @@ git2r_diff_tree_to_tree(
     SEXP tree1,
     SEXP tree2,
     SEXP filename,
+    int format,
     git_diff_options *opts)
 {
     int error, nprotect = 0;
@@ -744,48 +1391,9 @@ git2r_diff_tree_to_tree(
     if (error)
 	goto cleanup;
 
-    if (Rf_isNull(filename)) {
-        PROTECT(result = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff));
-        nprotect++;
-        Rf_setAttrib(result, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_diff));
-
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__old,
-            tree1);
-
-        SET_VECTOR_ELT(
-            result,
-            git2r_S3_item__git_diff__new,
-            tree2);
-
-        error = git2r_diff_format_to_r(diff, result);
-    } else if (0 == Rf_length(filename)) {
-        git_buf buf = GIT_BUF_INIT_CONST(NULL, 0);
-
-        error = git_diff_to_buf(
-            &buf,
-            diff,
-            GIT_DIFF_FORMAT_PATCH);
-        if (!error) {
-            PROTECT(result = Rf_mkString(buf.ptr));
-            nprotect++;
-        }
-
-        git_buf_dispose(&buf);
-    } else {
-        FILE *fp = fopen(CHAR(STRING_ELT(filename, 0)), "w+");
-
-        error = git_diff_print(
-            diff,
-            GIT_DIFF_FORMAT_PATCH,
-            git_diff_print_callback__to_file_handle,
-            fp);
-
-        if (fp)
-            fclose(fp);
-    }
+    error = git2r_diff_result(&result, diff, filename, format, tree1, tree2);
+    PROTECT(result);
+    nprotect++;
 
 cleanup:
     free(opts->pathspec.strings);
@@ -794,7 +1402,7 @@ cleanup:
     git_tree_free(c_tree2);
     git_object_free(obj1);
     git_object_free(obj2);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -806,439 +1414,1930 @@ cleanup:
 }
 
 /**
- * Data structure to hold the information when counting diff objects.
- */
-typedef struct {
-    size_t num_files;
-    size_t max_hunks;
-    size_t max_lines;
-    size_t num_hunks;
-    size_t num_lines;
-} git2r_diff_count_payload;
-
-/**
- * Callback per file in the diff
+ * Format a diff line as a S3 class git_diff_line.
  *
- * @param delta A pointer to the delta data for the file
- * @param progress Goes from 0 to 1 over the diff
- * @param payload A pointer to the git2r_diff_count_payload data structure
- * @return 0
+ * @param line A pointer to the structure describing a line (or data
+ * span) of a diff.
+ * @return The S3 class git_diff_line, unprotected.
  */
-static int
-git2r_diff_count_file_cb(
-    const git_diff_delta *delta,
-    float progress,
-    void *payload)
+static SEXP
+git2r_diff_line_to_r(
+    const git_diff_line *line)
 {
-    git2r_diff_count_payload *n = payload;
+    const char *nul;
+    size_t len;
+    SEXP line_obj;
 
-    GIT2R_UNUSED(delta);
-    GIT2R_UNUSED(progress);
+    PROTECT(line_obj = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_line));
+    Rf_setAttrib(
+        line_obj,
+        R_ClassSymbol,
+        Rf_mkString(git2r_S3_class__git_diff_line));
 
-    n->num_files += 1;
-    n->num_hunks = n->num_lines = 0;
-    return 0;
-}
+    SET_VECTOR_ELT(
+        line_obj,
+        git2r_S3_item__git_diff_line__origin,
+        Rf_ScalarInteger(line->origin));
 
-/**
- * Callback per hunk in the diff
- *
- * @param delta A pointer to the delta data for the file
- * @param hunk A pointer to the structure describing a hunk of a diff
- * @param payload A pointer to the git2r_diff_count_payload data structure
- * @return 0
- */
-static int
-git2r_diff_count_hunk_cb(
-    const git_diff_delta *delta,
-    const git_diff_hunk *hunk,
-    void *payload)
-{
-    git2r_diff_count_payload *n = payload;
+    SET_VECTOR_ELT(
+        line_obj,
+        git2r_S3_item__git_diff_line__old_lineno,
+        Rf_ScalarInteger(line->old_lineno));
 
-    GIT2R_UNUSED(delta);
-    GIT2R_UNUSED(hunk);
+    SET_VECTOR_ELT(
+        line_obj,
+        git2r_S3_item__git_diff_line__new_lineno,
+        Rf_ScalarInteger(line->new_lineno));
 
-    n->num_hunks += 1;
-    if (n->num_hunks > n->max_hunks)
-        n->max_hunks = n->num_hunks;
-    n->num_lines = 0;
-    return 0;
-}
+    SET_VECTOR_ELT(
+        line_obj,
+        git2r_S3_item__git_diff_line__num_lines,
+        Rf_ScalarInteger(line->num_lines));
 
-/**
- * Callback per text diff line
- *
- * @param delta A pointer to the delta data for the file
- * @param hunk A pointer to the structure describing a hunk of a diff
- * @param line A pointer to the structure describing a line (or data
- * span) of a diff.
- * @param payload A pointer to the git2r_diff_count_payload data structure
- * @return 0
- */
-static int
-git2r_diff_count_line_cb(
-    const git_diff_delta *delta,
-    const git_diff_hunk *hunk,
-    const git_diff_line *line,
-    void *payload)
-{
-    git2r_diff_count_payload *n = payload;
+    /* The content is not nul-terminated, and stops at an embedded
+     * nul. */
+    nul = memchr(line->content, 0, line->content_len);
+    len = nul ? (size_t)(nul - line->content) : line->content_len;
+    SET_VECTOR_ELT(
+        line_obj,
+        git2r_S3_item__git_diff_line__content,
+        Rf_ScalarString(Rf_mkCharLen(line->content, (int)len)));
 
-    GIT2R_UNUSED(delta);
-    GIT2R_UNUSED(hunk);
-    GIT2R_UNUSED(line);
+    UNPROTECT(1);
 
-    n->num_lines += 1;
-    if (n->num_lines > n->max_lines)
-        n->max_lines = n->num_lines;
-    return 0;
+    return line_obj;
 }
 
-
 /**
- *  Count diff objects
+ * Format a hunk of a patch, with its lines, as a S3 class
+ * git_diff_hunk.
  *
- * @param diff Pointer to the diff
- * @param num_files Pointer where to save the number of files
- * @param max_hunks Pointer where to save the maximum number of hunks
- * @param max_lines Pointer where to save the maximum number of lines
- * @return 0 if OK, else -1
+ * @param out The S3 class git_diff_hunk, unprotected.
+ * @param patch The patch.
+ * @param hunk_idx The index of the hunk in the patch.
+ * @return 0 if OK, else error code
  */
 static int
-git2r_diff_count(
-    git_diff *diff,
-    size_t *num_files,
-    size_t *max_hunks,
-    size_t *max_lines)
+git2r_diff_hunk_to_r(
+    SEXP *out,
+    git_patch *patch,
+    size_t hunk_idx)
 {
     int error;
-    git2r_diff_count_payload n = { 0, 0, 0 };
-
-    error = git_diff_foreach(
-        diff,
-        git2r_diff_count_file_cb,
-        /* binary_cb */ NULL,
-        git2r_diff_count_hunk_cb,
-        git2r_diff_count_line_cb,
-        /* payload= */ (void*) &n);
+    size_t i, n_lines;
+    const git_diff_hunk *hunk;
+    SEXP hunk_obj, lines;
 
+    error = git_patch_get_hunk(&hunk, &n_lines, patch, hunk_idx);
     if (error)
-	return -1;
+        return error;
 
-    *num_files = n.num_files;
-    *max_hunks = n.max_hunks;
-    *max_lines = n.max_lines;
+    PROTECT(hunk_obj = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_hunk));
+    Rf_setAttrib(
+        hunk_obj,
+        R_ClassSymbol,
+        Rf_mkString(git2r_S3_class__git_diff_hunk));
 
-    return 0;
-}
+    SET_VECTOR_ELT(
+        hunk_obj,
+        git2r_S3_item__git_diff_hunk__old_start,
+        Rf_ScalarInteger(hunk->old_start));
 
-/**
- * Data structure to hold the callback information when generating
- * diff objects.
- */
-typedef struct {
-    SEXP result;
-    SEXP hunk_tmp;
-    SEXP line_tmp;
-    size_t file_ptr, hunk_ptr, line_ptr;
-} git2r_diff_payload;
+    SET_VECTOR_ELT(
+        hunk_obj,
+        git2r_S3_item__git_diff_hunk__old_lines,
+        Rf_ScalarInteger(hunk->old_lines));
 
-static int
-git2r_diff_get_hunk_cb(
-    const git_diff_delta *delta,
-    const git_diff_hunk *hunk,
-    void *payload);
+    SET_VECTOR_ELT(
+        hunk_obj,
+        git2r_S3_item__git_diff_hunk__new_start,
+        Rf_ScalarInteger(hunk->new_start));
 
-static int
-git2r_diff_get_line_cb(
-    const git_diff_delta *delta,
-    const git_diff_hunk *hunk,
-    const git_diff_line *line,
-    void *payload);
+    SET_VECTOR_ELT(
+        hunk_obj,
+        git2r_S3_item__git_diff_hunk__new_lines,
+        Rf_ScalarInteger(hunk->new_lines));
+
+    SET_VECTOR_ELT(
+        hunk_obj,
+        git2r_S3_item__git_diff_hunk__header,
+        Rf_mkString(hunk->header));
+
+    SET_VECTOR_ELT(
+        hunk_obj,
+        git2r_S3_item__git_diff_hunk__lines,
+        lines = Rf_allocVector(VECSXP, n_lines));
+
+    for (i = 0; i < n_lines; i++) {
+        const git_diff_line *line;
+
+        error = git_patch_get_line_in_hunk(&line, patch, hunk_idx, i);
+        if (error)
+            break;
+        SET_VECTOR_ELT(lines, i, git2r_diff_line_to_r(line));
+    }
+
+    *out = hunk_obj;
+    UNPROTECT(1);
+
+    return error;
+}
 
 /**
- * Callback per file in the diff
+ * Format a diff as an R object
  *
- * @param delta A pointer to the delta data for the file
- * @param progress Goes from 0 to 1 over the diff
- * @param payload A pointer to the git2r_diff_payload data structure
- * @return 0
+ * The patch of each file is generated once with
+ * git_patch_from_diff. The patch knows the number of hunks and the
+ * number of lines in each hunk, so the lists are allocated with the
+ * right length and the diff is only walked once.
+ *
+ * @param diff Pointer to the diff
+ * @param dest The S3 class git_diff to hold the formated diff
+ * @return 0 if OK, else error code
  */
 static int
-git2r_diff_get_file_cb(
-    const git_diff_delta *delta,
-    float progress,
-    void *payload)
+git2r_diff_format_to_r(
+    git_diff *diff,
+    SEXP dest)
 {
-    git2r_diff_payload *p = (git2r_diff_payload *) payload;
-
-    GIT2R_UNUSED(progress);
+    int error = GIT_OK;
+    size_t i, j, n_deltas = git_diff_num_deltas(diff);
+    SEXP files;
 
-    /* Save previous hunk's lines in hunk_tmp, we just call the
-       hunk callback, with a NULL hunk */
-    git2r_diff_get_hunk_cb(delta, /* hunk= */ 0, payload);
+    SET_VECTOR_ELT(
+        dest,
+        git2r_S3_item__git_diff__files,
+        files = Rf_allocVector(VECSXP, n_deltas));
 
-    /* Save the previous file's hunks from the hunk_tmp
-       temporary storage. */
-    if (p->file_ptr != 0) {
-        SEXP hunks;
-	size_t len=p->hunk_ptr, i;
+    for (i = 0; !error && i < n_deltas; i++) {
+        git_patch *patch = NULL;
+        const git_diff_delta *delta;
+        size_t n_hunks;
+        SEXP file_obj, hunks;
 
-	SET_VECTOR_ELT(
-            VECTOR_ELT(p->result, p->file_ptr - 1),
-            git2r_S3_item__git_diff_file__hunks,
-            hunks = Rf_allocVector(VECSXP, p->hunk_ptr));
-	for (i = 0; i < len ; i++)
-	    SET_VECTOR_ELT(hunks, i, VECTOR_ELT(p->hunk_tmp, i));
-    }
+        error = git_patch_from_diff(&patch, diff, i);
+        if (error)
+            break;
 
-    /* OK, ready for next file, if any */
-    if (delta) {
-	SEXP file_obj;
+        delta = patch ? git_patch_get_delta(patch) : git_diff_get_delta(diff, i);
+        n_hunks = patch ? git_patch_num_hunks(patch) : 0;
 
-        PROTECT(file_obj = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_file));
+        SET_VECTOR_ELT(
+            files,
+            i,
+            file_obj = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_file));
         Rf_setAttrib(
             file_obj,
             R_ClassSymbol,
             Rf_mkString(git2r_S3_class__git_diff_file));
-        SET_VECTOR_ELT(p->result, p->file_ptr, file_obj);
 
-	SET_VECTOR_ELT(
+        SET_VECTOR_ELT(
             file_obj,
             git2r_S3_item__git_diff_file__old_file,
             Rf_mkString(delta->old_file.path));
 
-	SET_VECTOR_ELT(
+        SET_VECTOR_ELT(
             file_obj,
             git2r_S3_item__git_diff_file__new_file,
             Rf_mkString(delta->new_file.path));
 
-	p->file_ptr++;
-	p->hunk_ptr = 0;
-	p->line_ptr = 0;
-        UNPROTECT(1);
+        SET_VECTOR_ELT(
+            file_obj,
+            git2r_S3_item__git_diff_file__hunks,
+            hunks = Rf_allocVector(VECSXP, n_hunks));
+
+        for (j = 0; !error && j < n_hunks; j++) {
+            SEXP hunk_obj = R_NilValue;
+
+            error = git2r_diff_hunk_to_r(&hunk_obj, patch, j);
+            SET_VECTOR_ELT(hunks, j, hunk_obj);
+        }
+
+        git_patch_free(patch);
     }
 
-    return 0;
+    return error;
 }
 
 /**
- * Process a hunk
+ * The part of a worker that is shared by the pools of threads that
+ * diff a range of commits. It must be the first member of a worker.
+ */
+typedef struct git2r_diff_worker git2r_diff_worker;
+struct git2r_diff_worker {
+    git_repository *repository;
+    const char *repo_path;
+    int owns_repository;
+    size_t start;
+    size_t end;
+    int (*commit)(git2r_diff_worker *worker, size_t commit);
+    int error;
+    char *error_message;
+};
+
+/* The i:th worker in an array of workers of the given size. */
+#define GIT2R_DIFF_WORKER(workers, size, i) \
+    ((git2r_diff_worker *)((char *)(workers) + (i) * (size)))
+
+/**
+ * Copy the last libgit2 error of a worker thread, since the error is
+ * local to the thread.
+ *
+ * @param error_out The error code of the worker.
+ * @param message_out The copy of the error message. Free with
+ * 'free'.
+ * @param error The error code.
+ * @return void
+ */
+static void
+git2r_diff_worker_error(
+    int *error_out,
+    char **message_out,
+    int error)
+{
+    const git_error *err = git_error_last();
+    const char *msg = err && err->message ?
+        err->message : git2r_err_alloc_memory_buffer;
+
+    *error_out = error;
+    *message_out = malloc(strlen(msg) + 1);
+    if (*message_out)
+        strcpy(*message_out, msg);
+}
+
+/**
+ * Run a worker on its range of commits.
  *
- * First we save the previous hunk, if there was one. Then create an
- * empty hunk (i.e. without any lines) and put it in the result.
+ * A worker without a repository opens its own handle, which is kept
+ * until the workers are cleared since the patches of the worker may
+ * refer to it, and must not call the R API. The error message, if
+ * any, is copied since the libgit2 error is local to the thread.
  *
- * @param delta A pointer to the delta data for the file
- * @param hunk A pointer to the structure describing a hunk of a diff
- * @param payload Pointer to a git2r_diff_payload data structure
- * @return 0
+ * @param payload The worker.
+ * @return NULL
  */
-static int
-git2r_diff_get_hunk_cb(
-    const git_diff_delta *delta,
-    const git_diff_hunk *hunk,
+static void *
+git2r_diff_worker_run(
     void *payload)
 {
-    git2r_diff_payload *p = (git2r_diff_payload *) payload;
+    git2r_diff_worker *worker = payload;
+    size_t i;
+    int error = GIT_OK;
 
-    GIT2R_UNUSED(delta);
-
-    /* Save previous hunk's lines in hunk_tmp, from the line_tmp
-       temporary storage. */
-    if (p->hunk_ptr != 0) {
-	SEXP lines;
-	size_t len=p->line_ptr, i;
-
-	SET_VECTOR_ELT(
-            VECTOR_ELT(p->hunk_tmp, p->hunk_ptr-1),
-            git2r_S3_item__git_diff_hunk__lines,
-            lines = Rf_allocVector(VECSXP, p->line_ptr));
-	for (i = 0; i < len; i++)
-	    SET_VECTOR_ELT(lines, i, VECTOR_ELT(p->line_tmp, i));
+    if (!worker->repository) {
+        error = git_repository_open(&(worker->repository), worker->repo_path);
+        worker->owns_repository = !error;
     }
 
-    /* OK, ready for the next hunk, if any */
-    if (hunk) {
-	SEXP hunk_obj;
+    for (i = worker->start; !error && i < worker->end; i++)
+        error = worker->commit(worker, i);
 
-        PROTECT(hunk_obj = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_hunk));
-        Rf_setAttrib(
-            hunk_obj,
-            R_ClassSymbol,
-            Rf_mkString(git2r_S3_class__git_diff_hunk));
+    if (error)
+        git2r_diff_worker_error(&(worker->error), &(worker->error_message), error);
 
-        SET_VECTOR_ELT(
-            hunk_obj,
-            git2r_S3_item__git_diff_hunk__old_start,
-            Rf_ScalarInteger(hunk->old_start));
+    return NULL;
+}
 
-	SET_VECTOR_ELT(
-            hunk_obj,
-            git2r_S3_item__git_diff_hunk__old_lines,
-            Rf_ScalarInteger(hunk->old_lines));
+/**
+ * Run a function on each commit, on a pool of threads. Each worker
+ * gets a contiguous range of the commits, so the results of the
+ * workers are in the order of the commits. One worker uses the open
+ * repository in the main thread.
+ *
+ * @param workers The workers, that start with a git2r_diff_worker.
+ * @param n_workers The number of workers.
+ * @param size The size of a worker.
+ * @param repository The open repository.
+ * @param n The number of commits.
+ * @param commit The function to run on each commit.
+ * @return 0 on success, or the error of the first worker that
+ * failed.
+ */
+static int
+git2r_diff_workers_run(
+    void *workers,
+    size_t n_workers,
+    size_t size,
+    git_repository *repository,
+    size_t n,
+    int (*commit)(git2r_diff_worker *worker, size_t commit))
+{
+    size_t i;
 
-        SET_VECTOR_ELT(
-            hunk_obj,
-            git2r_S3_item__git_diff_hunk__new_start,
-            Rf_ScalarInteger(hunk->new_start));
+    for (i = 0; i < n_workers; i++) {
+        git2r_diff_worker *worker = GIT2R_DIFF_WORKER(workers, size, i);
+
+        worker->repo_path = git_repository_path(repository);
+        worker->start = n * i / n_workers;
+        worker->end = n * (i + 1) / n_workers;
+        worker->commit = commit;
+    }
 
-	SET_VECTOR_ELT(
-            hunk_obj,
-            git2r_S3_item__git_diff_hunk__new_lines,
-            Rf_ScalarInteger(hunk->new_lines));
+    if (n_workers > 1) {
+        git2r_thread_run(git2r_diff_worker_run, workers, n_workers, size);
+    } else {
+        GIT2R_DIFF_WORKER(workers, size, 0)->repository = repository;
+        git2r_diff_worker_run(workers);
+    }
 
-	SET_VECTOR_ELT(
-            hunk_obj,
-            git2r_S3_item__git_diff_hunk__header,
-            Rf_mkString(hunk->header));
+    for (i = 0; i < n_workers; i++) {
+        git2r_diff_worker *worker = GIT2R_DIFF_WORKER(workers, size, i);
 
-	SET_VECTOR_ELT(p->hunk_tmp, p->hunk_ptr, hunk_obj);
-        UNPROTECT(1);
-	p->hunk_ptr += 1;
-	p->line_ptr = 0;
+        if (worker->error) {
+            giterr_set_str(GIT_ERROR_NONE, worker->error_message ?
+                           worker->error_message :
+                           git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
     }
 
-    return 0;
+    return GIT_OK;
 }
 
 /**
- * Process a line
- *
- * This is easy, just populate a git_diff_line object and
- * put it in the temporary hunk.
+ * Free the error messages of the workers, and the repositories that
+ * the workers opened.
  *
- * @param delta A pointer to the delta data for the file
- * @param hunk A pointer to the structure describing a hunk of a diff
- * @param line A pointer to the structure describing a line (or data
- * span) of a diff.
- * @param payload Pointer to a git2r_diff_payload data structure
- * @return 0
+ * @param workers The workers, or NULL.
+ * @param n_workers The number of workers.
+ * @param size The size of a worker.
+ * @return void
  */
-static int
-git2r_diff_get_line_cb(
-    const git_diff_delta *delta,
-    const git_diff_hunk *hunk,
-    const git_diff_line *line,
-    void *payload)
+static void
+git2r_diff_workers_clear(
+    void *workers,
+    size_t n_workers,
+    size_t size)
 {
-    git2r_diff_payload *p = (git2r_diff_payload *) payload;
-    static char short_buffer[200];
-    char *buffer = short_buffer;
-    SEXP line_obj;
+    size_t i;
 
-    GIT2R_UNUSED(delta);
-    GIT2R_UNUSED(hunk);
+    for (i = 0; workers && i < n_workers; i++) {
+        git2r_diff_worker *worker = GIT2R_DIFF_WORKER(workers, size, i);
 
-    PROTECT(line_obj = Rf_mkNamed(VECSXP, git2r_S3_items__git_diff_line));
-    Rf_setAttrib(
-        line_obj,
-        R_ClassSymbol,
-        Rf_mkString(git2r_S3_class__git_diff_line));
+        free(worker->error_message);
+        if (worker->owns_repository)
+            git_repository_free(worker->repository);
+    }
+}
 
-    SET_VECTOR_ELT(
-        line_obj,
-        git2r_S3_item__git_diff_line__origin,
-        Rf_ScalarInteger(line->origin));
+/**
+ * A path in a commit where the pickaxe matched.
+ */
+typedef struct {
+    size_t commit;
+    char *path;
+} git2r_pickaxe_match;
 
-    SET_VECTOR_ELT(
-        line_obj,
-        git2r_S3_item__git_diff_line__old_lineno,
-        Rf_ScalarInteger(line->old_lineno));
+/**
+ * Work item for the pickaxe of a range of commits.
+ */
+typedef struct {
+    git2r_diff_worker base;
+    const git_oid *oids;
+    const char *needle;
+    size_t needle_len;
+    const git_strarray *pathspec;
+    SEXP regex_fun;
+    git2r_oidmap counts;
+    git2r_pickaxe_match *matches;
+    size_t n_matches;
+    size_t matches_capacity;
+} git2r_pickaxe_worker;
 
-    SET_VECTOR_ELT(
-        line_obj,
-        git2r_S3_item__git_diff_line__new_lineno,
-        Rf_ScalarInteger(line->new_lineno));
+/**
+ * Count the non-overlapping occurrences of a needle, as with
+ * 'git log -S'.
+ *
+ * @param data The data to search.
+ * @param size The size of the data.
+ * @param needle The fixed string to count.
+ * @param needle_len The length of the needle, which must be at least
+ * one.
+ * @return The number of occurrences.
+ */
+static size_t
+git2r_pickaxe_count(
+    const char *data,
+    size_t size,
+    const char *needle,
+    size_t needle_len)
+{
+    size_t n = 0, pos = 0;
+
+    while (size >= needle_len && pos <= size - needle_len) {
+        const char *p = memchr(data + pos, needle[0],
+                               size - needle_len - pos + 1);
+
+        if (!p)
+            break;
+        pos = (size_t)(p - data);
+        if (!memcmp(p + 1, needle + 1, needle_len - 1)) {
+            n++;
+            pos += needle_len;
+        } else {
+            pos++;
+        }
+    }
 
-    SET_VECTOR_ELT(
-        line_obj,
-        git2r_S3_item__git_diff_line__num_lines,
-        Rf_ScalarInteger(line->num_lines));
+    return n;
+}
 
-    if (line->content_len > sizeof(buffer))
-	buffer = malloc(line->content_len+1);
-    memcpy(buffer, line->content, line->content_len);
-    buffer[line->content_len] = 0;
+/**
+ * Count the occurrences of the needle in a blob. The count of each
+ * blob is saved, since most blobs are the new side of one diff and
+ * the old side of the next.
+ *
+ * @param out The number of occurrences, 0 for the zero id of an
+ * added or deleted file.
+ * @param worker The worker.
+ * @param oid The id of the blob.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_pickaxe_blob_count(
+    size_t *out,
+    git2r_pickaxe_worker *worker,
+    const git_oid *oid)
+{
+    int error;
+    git_blob *blob = NULL;
 
-    SET_VECTOR_ELT(
-        line_obj,
-        git2r_S3_item__git_diff_line__content,
-        Rf_mkString(buffer));
+    *out = 0;
+    if (git_oid_is_zero(oid) || git2r_oidmap_get(out, &(worker->counts), oid))
+        return GIT_OK;
 
-    if (buffer != short_buffer)
-	free(buffer);
+    error = git_blob_lookup(&blob, worker->base.repository, oid);
+    if (error)
+        return error;
 
-    SET_VECTOR_ELT(p->line_tmp, p->line_ptr++, line_obj);
-    UNPROTECT(1);
+    *out = git2r_pickaxe_count(git_blob_rawcontent(blob),
+                               (size_t)git_blob_rawsize(blob),
+                               worker->needle, worker->needle_len);
+    git_blob_free(blob);
 
-    return 0;
+    return git2r_oidmap_put(&(worker->counts), oid, *out);
 }
 
 /**
- * Format a diff as an R object
+ * Save a path where the pickaxe matched.
  *
- * libgit2 has callbacks to walk over the files, hunks and line
- * of a diff. This means that we need to walk over the diff twice,
- * if we don't want to reallocate our lists over and over again (or write a
- * smart list that preallocates memory).
- *
- * So we walk over it first and calculate the maximum number of
- * hunks in a file, and the maximum number of lines in a hunk.
+ * @param worker The worker.
+ * @param commit The index of the commit.
+ * @param path The path.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_pickaxe_add_match(
+    git2r_pickaxe_worker *worker,
+    size_t commit,
+    const char *path)
+{
+    char *copy;
+
+    if (worker->n_matches == worker->matches_capacity) {
+        size_t capacity = worker->matches_capacity ?
+            2 * worker->matches_capacity : 64;
+        git2r_pickaxe_match *matches = realloc(
+            worker->matches, capacity * sizeof(git2r_pickaxe_match));
+
+        if (!matches)
+            goto on_error;
+        worker->matches = matches;
+        worker->matches_capacity = capacity;
+    }
+
+    copy = malloc(strlen(path) + 1);
+    if (!copy)
+        goto on_error;
+    strcpy(copy, path);
+
+    worker->matches[worker->n_matches].commit = commit;
+    worker->matches[worker->n_matches].path = copy;
+    worker->n_matches++;
+
+    return GIT_OK;
+
+on_error:
+    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+    return GIT_ERROR;
+}
+
+/**
+ * Match the added and removed lines of the changed files of a
+ * commit with the regular expression of the worker, as with 'git
+ * log -G'.
  *
- * Then in the second walk, we have a correspondingly allocated
- * list that we use for temporary storage.
+ * The lines of all files are matched in one call to 'regex_fun', so
+ * this must run in the main thread.
  *
- * @param diff Pointer to the diff
- * @param dest The S3 class git_diff to hold the formated diff
- * @return 0 if OK, else error code
+ * @param worker The worker.
+ * @param diff The diff of the commit.
+ * @param commit The index of the commit.
+ * @return 0 on success, or an error code.
  */
 static int
-git2r_diff_format_to_r(
+git2r_pickaxe_regex(
+    git2r_pickaxe_worker *worker,
     git_diff *diff,
-    SEXP dest)
+    size_t commit)
 {
-    int error, nprotect = 0;
-    git2r_diff_payload payload = { /* result=   */ R_NilValue,
-                                   /* hunk_tmp= */ R_NilValue,
-                                   /* line_tmp= */ R_NilValue,
-                                   /* file_ptr= */ 0,
-                                   /* hunk_ptr= */ 0,
-                                   /* line_ptr= */ 0 };
+    int error = GIT_OK, nprotect = 0, eval_error = 0;
+    size_t i, j, k, n_deltas = git_diff_num_deltas(diff), n_lines = 0;
+    size_t *owner = NULL;
+    git_patch **patches = NULL;
+    SEXP lines, call, result;
+
+    patches = calloc(n_deltas ? n_deltas : 1, sizeof(git_patch *));
+    if (!patches) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+
+    /* Count the added and removed lines. */
+    for (i = 0; i < n_deltas; i++) {
+        size_t additions, deletions;
 
-    size_t num_files, max_hunks, max_lines;
+        error = git_patch_from_diff(&patches[i], diff, i);
+        if (error)
+            goto cleanup;
+        if (!patches[i])
+            continue;
 
-    error = git2r_diff_count(diff, &num_files, &max_hunks, &max_lines);
+        error = git_patch_line_stats(NULL, &additions, &deletions, patches[i]);
+        if (error)
+            goto cleanup;
+        n_lines += additions + deletions;
+    }
 
-    if (error)
-        return error;
+    if (!n_lines)
+        goto cleanup;
 
-    SET_VECTOR_ELT(
-        dest,
-        git2r_S3_item__git_diff__files,
-        payload.result = Rf_allocVector(VECSXP, num_files));
-    PROTECT(payload.hunk_tmp = Rf_allocVector(VECSXP, max_hunks));
+    owner = malloc(n_lines * sizeof(size_t));
+    if (!owner) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    PROTECT(lines = Rf_allocVector(STRSXP, n_lines));
     nprotect++;
-    PROTECT(payload.line_tmp = Rf_allocVector(VECSXP, max_lines));
+    for (i = 0, k = 0; i < n_deltas; i++) {
+        size_t h, n_hunks;
+
+        if (!patches[i])
+            continue;
+
+        n_hunks = git_patch_num_hunks(patches[i]);
+        for (h = 0; h < n_hunks; h++) {
+            int n_hunk_lines = git_patch_num_lines_in_hunk(patches[i], h);
+
+            for (j = 0; j < (size_t)n_hunk_lines && k < n_lines; j++) {
+                const git_diff_line *line;
+                size_t len;
+
+                error = git_patch_get_line_in_hunk(&line, patches[i], h, j);
+                if (error)
+                    goto cleanup;
+                if (line->origin != GIT_DIFF_LINE_ADDITION &&
+                    line->origin != GIT_DIFF_LINE_DELETION)
+                    continue;
+
+                len = line->content_len;
+                if (len && line->content[len - 1] == '\n')
+                    len--;
+                /* A file has no encoding, so the lines are bytes. */
+                SET_STRING_ELT(lines, k, Rf_mkCharLenCE(line->content,
+                                                        (int)len, CE_BYTES));
+                owner[k++] = i;
+            }
+        }
+    }
+
+    PROTECT(call = Rf_lang2(worker->regex_fun, lines));
     nprotect++;
+    result = R_tryEval(call, R_GlobalEnv, &eval_error);
+    if (eval_error || !Rf_isLogical(result) ||
+        (size_t)Rf_xlength(result) != n_lines) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_pickaxe_regex);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
 
-    error = git_diff_foreach(
-        diff,
-        git2r_diff_get_file_cb,
-        /* binary_cb */ NULL,
-        git2r_diff_get_hunk_cb,
-        git2r_diff_get_line_cb,
-        &payload);
-    if (!error) {
-        /* Need to call them once more, to put in the last lines/hunks/files. */
-        error = git2r_diff_get_file_cb(
-            /* delta=    */ NULL,
-            /* progress= */ 100,
-            &payload);
+    /* Save each file with a matching line once. */
+    for (k = 0; !error && k < n_lines; k++) {
+        if (LOGICAL(result)[k] == TRUE) {
+            const git_diff_delta *delta = git_diff_get_delta(diff, owner[k]);
+
+            error = git2r_pickaxe_add_match(worker, commit,
+                                            delta->new_file.path);
+            while (k + 1 < n_lines && owner[k + 1] == owner[k])
+                k++;
+        }
     }
 
+cleanup:
+    for (i = 0; i < n_deltas; i++)
+        git_patch_free(patches[i]);
+    free(patches);
+    free(owner);
+
     if (nprotect)
         UNPROTECT(nprotect);
 
     return error;
 }
+
+/**
+ * Diff a commit with its first parent, tree to tree, or with the
+ * empty tree for a root commit. Only the files with a changed blob
+ * id are in the diff, so unchanged blobs are never read.
+ *
+ * @param out The diff, or NULL for a merge commit that is skipped.
+ * @param repository The repository.
+ * @param oid The id of the commit.
+ * @param merges If 0, skip a merge commit, as with 'git log', else
+ * diff a merge commit with its first parent.
+ * @param opts The diff options.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_diff_commit(
+    git_diff **out,
+    git_repository *repository,
+    const git_oid *oid,
+    int merges,
+    const git_diff_options *opts)
+{
+    int error;
+    git_commit *commit = NULL, *parent = NULL;
+    git_tree *tree = NULL, *parent_tree = NULL;
+
+    *out = NULL;
+
+    error = git_commit_lookup(&commit, repository, oid);
+    if (error)
+        goto cleanup;
+    if (!merges && git_commit_parentcount(commit) > 1)
+        goto cleanup;
+
+    if (git_commit_parentcount(commit)) {
+        error = git_commit_parent(&parent, commit, 0);
+        if (!error)
+            error = git_commit_tree(&parent_tree, parent);
+        if (error)
+            goto cleanup;
+    }
+
+    error = git_commit_tree(&tree, commit);
+    if (error)
+        goto cleanup;
+
+    error = git_diff_tree_to_tree(out, repository, parent_tree, tree, opts);
+
+cleanup:
+    git_tree_free(tree);
+    git_tree_free(parent_tree);
+    git_commit_free(parent);
+    git_commit_free(commit);
+
+    return error;
+}
+
+/**
+ * Parse the sha of commits.
+ *
+ * @param out The ids of the commits. Free with 'free'.
+ * @param commits Character vector with the sha of the commits.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_diff_commit_oids(
+    git_oid **out,
+    SEXP commits)
+{
+    int error;
+    size_t i, n = (size_t)Rf_xlength(commits);
+
+    *out = malloc((n ? n : 1) * sizeof(git_oid));
+    if (!*out) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+
+    for (i = 0; i < n; i++) {
+        error = git_oid_fromstr(&((*out)[i]), CHAR(STRING_ELT(commits, i)));
+        if (error)
+            return error;
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Run the pickaxe on one commit. Merge commits are skipped, as with
+ * 'git log -S'.
+ *
+ * @param base The git2r_pickaxe_worker.
+ * @param commit The index of the commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_pickaxe_commit(
+    git2r_diff_worker *base,
+    size_t commit)
+{
+    git2r_pickaxe_worker *worker = (git2r_pickaxe_worker *)base;
+    int error;
+    size_t i;
+    git_diff *diff = NULL;
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+
+    /* As in git, the blobs of binary files are searched for the
+     * string, while the patch of a binary file has no lines to match
+     * the regular expression. */
+    if (!worker->regex_fun)
+        opts.flags |= GIT_DIFF_SKIP_BINARY_CHECK;
+    if (worker->pathspec)
+        opts.pathspec = *(worker->pathspec);
+
+    error = git2r_diff_commit(&diff, base->repository,
+                              &(worker->oids[commit]), 0, &opts);
+    if (error || !diff)
+        goto cleanup;
+
+    if (worker->regex_fun) {
+        error = git2r_pickaxe_regex(worker, diff, commit);
+        goto cleanup;
+    }
+
+    for (i = 0; !error && i < git_diff_num_deltas(diff); i++) {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+        size_t old_count, new_count;
+
+        if (delta->old_file.mode == GIT_FILEMODE_COMMIT ||
+            delta->new_file.mode == GIT_FILEMODE_COMMIT)
+            continue;
+
+        error = git2r_pickaxe_blob_count(&old_count, worker,
+                                         &(delta->old_file.id));
+        if (!error) {
+            error = git2r_pickaxe_blob_count(&new_count, worker,
+                                             &(delta->new_file.id));
+        }
+        if (!error && old_count != new_count) {
+            error = git2r_pickaxe_add_match(worker, commit,
+                                            delta->new_file.path);
+        }
+    }
+
+cleanup:
+    git_diff_free(diff);
+
+    return error;
+}
+
+/**
+ * Find the commits that change the number of occurrences of a
+ * string, or that add or remove lines matching a regular
+ * expression.
+ *
+ * @param repo S3 class git_repository
+ * @param commits Character vector with the sha of the commits to
+ * search.
+ * @param pattern The string to count in the blobs, as with 'git log
+ * -S'. Not used if 'regex_fun' is not R_NilValue.
+ * @param regex_fun R_NilValue, or an R function that takes a
+ * character vector with the added and removed lines and returns a
+ * logical vector with the lines that match, as with 'git log -G'.
+ * @param path A character vector of paths / fnmatch patterns to
+ * constrain the search, or R_NilValue for all paths.
+ * @param threads The number of threads. One thread is used with
+ * 'regex_fun', or if libgit2 is built without thread support.
+ * @return list with the character vectors 'sha' and 'path', with one
+ * item for each changed file that matches.
+ */
+SEXP attribute_hidden
+git2r_diff_pickaxe(
+    SEXP repo,
+    SEXP commits,
+    SEXP pattern,
+    SEXP regex_fun,
+    SEXP path,
+    SEXP threads)
+{
+    int error = GIT_OK, nprotect = 0;
+    size_t i, j, k, n, n_threads, n_matches = 0;
+    SEXP result = R_NilValue, names, sha, paths;
+    git_oid *oids = NULL;
+    git_strarray pathspec = {NULL, 0};
+    git2r_pickaxe_worker *workers = NULL;
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string_vec(commits))
+        git2r_error(__func__, NULL, "'commits'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_string(pattern))
+        git2r_error(__func__, NULL, "'pattern'", git2r_err_string_arg);
+    if (!Rf_isNull(regex_fun) && !Rf_isFunction(regex_fun))
+        git2r_error(__func__, NULL, "'regex_fun'", git2r_err_function_arg);
+    if (Rf_isNull(regex_fun) && !strlen(CHAR(STRING_ELT(pattern, 0))))
+        git2r_error(__func__, NULL, "'pattern'", git2r_err_string_arg);
+    if (!Rf_isNull(path) && git2r_arg_check_string_vec(path))
+        git2r_error(__func__, NULL, "'path'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_integer_gte_zero(threads))
+        git2r_error(__func__, NULL, "'threads'", git2r_err_integer_gte_zero_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    n = (size_t)Rf_xlength(commits);
+    error = git2r_diff_commit_oids(&oids, commits);
+    if (error)
+        goto cleanup;
+
+    if (!Rf_isNull(path)) {
+        error = git2r_copy_string_vec(&pathspec, path);
+        if (error)
+            goto cleanup;
+    }
+
+    n_threads = git2r_thread_count(INTEGER(threads)[0], n);
+    if (!Rf_isNull(regex_fun))
+        n_threads = 1;
+
+    workers = calloc(n_threads, sizeof(git2r_pickaxe_worker));
+    if (!workers) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n_threads; i++) {
+        workers[i].oids = oids;
+        workers[i].needle = CHAR(STRING_ELT(pattern, 0));
+        workers[i].needle_len = strlen(workers[i].needle);
+        workers[i].pathspec = pathspec.count ? &pathspec : NULL;
+        if (!Rf_isNull(regex_fun))
+            workers[i].regex_fun = regex_fun;
+    }
+
+    error = git2r_diff_workers_run(workers, n_threads,
+                                   sizeof(git2r_pickaxe_worker), repository,
+                                   n, git2r_pickaxe_commit);
+    if (error)
+        goto cleanup;
+
+    for (i = 0; i < n_threads; i++)
+        n_matches += workers[i].n_matches;
+
+    PROTECT(result = Rf_allocVector(VECSXP, 2));
+    nprotect++;
+    Rf_setAttrib(result, R_NamesSymbol, names = Rf_allocVector(STRSXP, 2));
+    SET_STRING_ELT(names, 0, Rf_mkChar("sha"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("path"));
+    SET_VECTOR_ELT(result, 0, sha = Rf_allocVector(STRSXP, n_matches));
+    SET_VECTOR_ELT(result, 1, paths = Rf_allocVector(STRSXP, n_matches));
+
+    /* The workers have contiguous ranges of commits, so the matches
+     * are in the order of the commits. */
+    for (i = 0, k = 0; i < n_threads; i++) {
+        for (j = 0; j < workers[i].n_matches; j++, k++) {
+            const git2r_pickaxe_match *match = &(workers[i].matches[j]);
+
+            SET_STRING_ELT(sha, k, STRING_ELT(commits, match->commit));
+            SET_STRING_ELT(paths, k, Rf_mkCharCE(match->path, CE_UTF8));
+        }
+    }
+
+cleanup:
+    for (i = 0; workers && i < n_threads; i++) {
+        for (j = 0; j < workers[i].n_matches; j++)
+            free(workers[i].matches[j].path);
+        free(workers[i].matches);
+        git2r_oidmap_free(&(workers[i].counts));
+    }
+    git2r_diff_workers_clear(workers, n_threads, sizeof(git2r_pickaxe_worker));
+    free(workers);
+    free(oids);
+    free(pathspec.strings);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * The number of added and deleted lines of a file in a commit. The
+ * number of lines is -1 for a binary file. The patch is only kept
+ * for the hunks and lines of 'diff_commits()'.
+ */
+typedef struct {
+    size_t commit;
+    char *path;
+    char *old_path;
+    int additions;
+    int deletions;
+    git_delta_t status;
+    git_patch *patch;
+} git2r_numstat_row;
+
+/**
+ * Work item for the numstat of a range of commits. The commits are
+ * diffed with the old revisions in 'old', if not NULL, else with
+ * their first parent.
+ */
+typedef struct {
+    git2r_diff_worker base;
+    const git_oid *oids;
+    const git_oid *old;
+    const git_diff_options *opts;
+    int renames;
+    int merges;
+    int patches;
+    git2r_numstat_row *rows;
+    size_t n_rows;
+    size_t rows_capacity;
+} git2r_numstat_worker;
+
+/**
+ * Save the numstat of a file.
+ *
+ * @param worker The worker.
+ * @param commit The index of the commit.
+ * @param delta The delta of the file.
+ * @param additions The number of added lines, or -1.
+ * @param deletions The number of deleted lines, or -1.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_numstat_add_row(
+    git2r_numstat_worker *worker,
+    size_t commit,
+    const git_diff_delta *delta,
+    int additions,
+    int deletions)
+{
+    git2r_numstat_row *row;
+
+    if (worker->n_rows == worker->rows_capacity) {
+        size_t capacity = worker->rows_capacity ?
+            2 * worker->rows_capacity : 256;
+        git2r_numstat_row *rows = realloc(
+            worker->rows, capacity * sizeof(git2r_numstat_row));
+
+        if (!rows)
+            goto on_error;
+        worker->rows = rows;
+        worker->rows_capacity = capacity;
+    }
+
+    row = &(worker->rows[worker->n_rows]);
+    memset(row, 0, sizeof(git2r_numstat_row));
+    worker->n_rows++;
+
+    row->commit = commit;
+    row->additions = additions;
+    row->deletions = deletions;
+    row->status = delta->status;
+    row->path = malloc(strlen(delta->new_file.path) + 1);
+    if (!row->path)
+        goto on_error;
+    strcpy(row->path, delta->new_file.path);
+
+    if (delta->status == GIT_DELTA_RENAMED ||
+        delta->status == GIT_DELTA_COPIED) {
+        row->old_path = malloc(strlen(delta->old_file.path) + 1);
+        if (!row->old_path)
+            goto on_error;
+        strcpy(row->old_path, delta->old_file.path);
+    }
+
+    return GIT_OK;
+
+on_error:
+    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+    return GIT_ERROR;
+}
+
+/**
+ * Diff two revisions tree to tree.
+ *
+ * @param out The diff.
+ * @param repository The repository.
+ * @param old_oid The id of the old commit or tree.
+ * @param new_oid The id of the new commit or tree.
+ * @param opts The diff options.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_diff_revisions(
+    git_diff **out,
+    git_repository *repository,
+    const git_oid *old_oid,
+    const git_oid *new_oid,
+    const git_diff_options *opts)
+{
+    int error;
+    git_object *old_obj = NULL, *new_obj = NULL;
+    git_tree *old_tree = NULL, *new_tree = NULL;
+
+    *out = NULL;
+
+    error = git_object_lookup(&old_obj, repository, old_oid, GIT_OBJECT_ANY);
+    if (!error)
+        error = git_object_peel((git_object **)&old_tree, old_obj, GIT_OBJECT_TREE);
+    if (!error)
+        error = git_object_lookup(&new_obj, repository, new_oid, GIT_OBJECT_ANY);
+    if (!error)
+        error = git_object_peel((git_object **)&new_tree, new_obj, GIT_OBJECT_TREE);
+    if (!error)
+        error = git_diff_tree_to_tree(out, repository, old_tree, new_tree, opts);
+
+    git_tree_free(new_tree);
+    git_tree_free(old_tree);
+    git_object_free(new_obj);
+    git_object_free(old_obj);
+
+    return error;
+}
+
+/**
+ * Count the added and deleted lines of the files in one commit.
+ *
+ * The lines are only counted by the patch of each file, and never
+ * copied. Unless the worker diffs merges, merge commits are skipped,
+ * as with 'git log --numstat'.
+ *
+ * @param base The git2r_numstat_worker.
+ * @param commit The index of the commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_numstat_commit(
+    git2r_diff_worker *base,
+    size_t commit)
+{
+    git2r_numstat_worker *worker = (git2r_numstat_worker *)base;
+    int error;
+    size_t i;
+    git_diff *diff = NULL;
+
+    if (worker->old) {
+        error = git2r_diff_revisions(&diff, base->repository,
+                                     &(worker->old[commit]),
+                                     &(worker->oids[commit]), worker->opts);
+    } else {
+        error = git2r_diff_commit(&diff, base->repository,
+                                  &(worker->oids[commit]), worker->merges,
+                                  worker->opts);
+    }
+    if (error || !diff)
+        goto cleanup;
+
+    if (worker->renames) {
+        git_diff_find_options findopts = GIT_DIFF_FIND_OPTIONS_INIT;
+
+        findopts.flags = GIT_DIFF_FIND_RENAMES;
+        error = git_diff_find_similar(diff, &findopts);
+        if (error)
+            goto cleanup;
+    }
+
+    for (i = 0; !error && i < git_diff_num_deltas(diff); i++) {
+        git_patch *patch = NULL;
+        const git_diff_delta *delta;
+        size_t additions = 0, deletions = 0;
+        int binary;
+
+        error = git_patch_from_diff(&patch, diff, i);
+        if (error)
+            break;
+
+        /* The binary flag of the delta is set by the patch. */
+        delta = patch ? git_patch_get_delta(patch) : git_diff_get_delta(diff, i);
+        binary = delta->flags & GIT_DIFF_FLAG_BINARY;
+        if (patch && !binary)
+            error = git_patch_line_stats(NULL, &additions, &deletions, patch);
+
+        if (!error) {
+            error = git2r_numstat_add_row(
+                worker, commit, delta,
+                binary ? -1 : (int)additions, binary ? -1 : (int)deletions);
+        }
+
+        if (!error && worker->patches) {
+            worker->rows[worker->n_rows - 1].patch = patch;
+            patch = NULL;
+        }
+
+        git_patch_free(patch);
+    }
+
+cleanup:
+    git_diff_free(diff);
+
+    return error;
+}
+
+/**
+ * Free the numstat workers and their rows.
+ *
+ * @param workers The workers, or NULL.
+ * @param n_workers The number of workers.
+ * @return void
+ */
+static void
+git2r_numstat_workers_free(
+    git2r_numstat_worker *workers,
+    size_t n_workers)
+{
+    size_t i, j;
+
+    for (i = 0; workers && i < n_workers; i++) {
+        for (j = 0; j < workers[i].n_rows; j++) {
+            free(workers[i].rows[j].path);
+            free(workers[i].rows[j].old_path);
+            git_patch_free(workers[i].rows[j].patch);
+        }
+        free(workers[i].rows);
+    }
+
+    /* The patches may refer to the repositories of the workers. */
+    git2r_diff_workers_clear(workers, n_workers, sizeof(git2r_numstat_worker));
+    free(workers);
+}
+
+/**
+ * Count the added and deleted lines of each changed file in many
+ * commits, as with 'git log --numstat'.
+ *
+ * @param repo S3 class git_repository
+ * @param commits Character vector with the sha of the commits.
+ * @param path A character vector of paths / fnmatch patterns to
+ * constrain the diff, or R_NilValue for all paths.
+ * @param renames Detect renamed files.
+ * @param threads The number of threads. One thread is used if
+ * libgit2 is built without thread support.
+ * @return list with the columns 'sha', 'path', 'additions',
+ * 'deletions', 'status' and 'old_path', with one item for each
+ * changed file in each commit.
+ */
+SEXP attribute_hidden
+git2r_diff_numstat(
+    SEXP repo,
+    SEXP commits,
+    SEXP path,
+    SEXP renames,
+    SEXP threads)
+{
+    int error = GIT_OK, nprotect = 0;
+    size_t i, j, k, n, n_threads, n_rows = 0;
+    SEXP result = R_NilValue, names, sha, paths, additions, deletions;
+    SEXP status, old_paths;
+    git_oid *oids = NULL;
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    git2r_numstat_worker *workers = NULL;
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string_vec(commits))
+        git2r_error(__func__, NULL, "'commits'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(path) && git2r_arg_check_string_vec(path))
+        git2r_error(__func__, NULL, "'path'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_logical(renames))
+        git2r_error(__func__, NULL, "'renames'", git2r_err_logical_arg);
+    if (git2r_arg_check_integer_gte_zero(threads))
+        git2r_error(__func__, NULL, "'threads'", git2r_err_integer_gte_zero_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    n = (size_t)Rf_xlength(commits);
+    error = git2r_diff_commit_oids(&oids, commits);
+    if (error)
+        goto cleanup;
+
+    if (!Rf_isNull(path)) {
+        error = git2r_copy_string_vec(&(opts.pathspec), path);
+        if (error)
+            goto cleanup;
+    }
+
+    n_threads = git2r_thread_count(INTEGER(threads)[0], n);
+
+    workers = calloc(n_threads, sizeof(git2r_numstat_worker));
+    if (!workers) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n_threads; i++) {
+        workers[i].oids = oids;
+        workers[i].opts = &opts;
+        workers[i].renames = LOGICAL(renames)[0];
+    }
+
+    error = git2r_diff_workers_run(workers, n_threads,
+                                   sizeof(git2r_numstat_worker), repository,
+                                   n, git2r_numstat_commit);
+    if (error)
+        goto cleanup;
+
+    for (i = 0; i < n_threads; i++)
+        n_rows += workers[i].n_rows;
+
+    PROTECT(result = Rf_allocVector(VECSXP, 6));
+    nprotect++;
+    Rf_setAttrib(result, R_NamesSymbol, names = Rf_allocVector(STRSXP, 6));
+    SET_STRING_ELT(names, 0, Rf_mkChar("sha"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("path"));
+    SET_STRING_ELT(names, 2, Rf_mkChar("additions"));
+    SET_STRING_ELT(names, 3, Rf_mkChar("deletions"));
+    SET_STRING_ELT(names, 4, Rf_mkChar("status"));
+    SET_STRING_ELT(names, 5, Rf_mkChar("old_path"));
+    SET_VECTOR_ELT(result, 0, sha = Rf_allocVector(STRSXP, n_rows));
+    SET_VECTOR_ELT(result, 1, paths = Rf_allocVector(STRSXP, n_rows));
+    SET_VECTOR_ELT(result, 2, additions = Rf_allocVector(INTSXP, n_rows));
+    SET_VECTOR_ELT(result, 3, deletions = Rf_allocVector(INTSXP, n_rows));
+    SET_VECTOR_ELT(result, 4, status = Rf_allocVector(STRSXP, n_rows));
+    SET_VECTOR_ELT(result, 5, old_paths = Rf_allocVector(STRSXP, n_rows));
+
+    /* The workers have contiguous ranges of commits, so the rows are
+     * in the order of the commits. */
+    for (i = 0, k = 0; i < n_threads; i++) {
+        for (j = 0; j < workers[i].n_rows; j++, k++) {
+            const git2r_numstat_row *row = &(workers[i].rows[j]);
+
+            SET_STRING_ELT(sha, k, STRING_ELT(commits, row->commit));
+            SET_STRING_ELT(paths, k, Rf_mkCharCE(row->path, CE_UTF8));
+            INTEGER(additions)[k] = row->additions < 0 ?
+                NA_INTEGER : row->additions;
+            INTEGER(deletions)[k] = row->deletions < 0 ?
+                NA_INTEGER : row->deletions;
+            SET_STRING_ELT(status, k,
+                           Rf_mkChar(git2r_diff_status_name(row->status)));
+            SET_STRING_ELT(old_paths, k, row->old_path ?
+                           Rf_mkCharCE(row->old_path, CE_UTF8) : NA_STRING);
+        }
+    }
+
+cleanup:
+    git2r_numstat_workers_free(workers, n_threads);
+    free(oids);
+    free(opts.pathspec.strings);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Hash map from a path to its index in the co-change table.
+ */
+typedef struct {
+    char **paths;     /* The paths in the order they were added. */
+    size_t n_paths;
+    size_t paths_capacity;
+    size_t *slots;    /* Index + 1 into paths, 0 for an empty slot. */
+    size_t n_slots;   /* A power of two. */
+} git2r_cochange_paths;
+
+/**
+ * Hash map from a pair of path indices to the number of commits
+ * that change both paths.
+ */
+typedef struct {
+    uint64_t key;     /* (i << 32) | j with i <= j. */
+    size_t count;     /* 0 for an empty slot. */
+} git2r_cochange_pair;
+
+typedef struct {
+    git2r_cochange_pair *slots;
+    size_t n_pairs;
+    size_t n_slots;   /* A power of two. */
+} git2r_cochange_pairs;
+
+/**
+ * FNV-1a hash of a path.
+ *
+ * @param path The path.
+ * @return The hash.
+ */
+static uint64_t
+git2r_cochange_hash_path(
+    const char *path)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (; *path; path++) {
+        h ^= (unsigned char)*path;
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+/**
+ * Mix the bits of a pair key.
+ *
+ * @param key The key.
+ * @return The hash.
+ */
+static uint64_t
+git2r_cochange_hash_pair(
+    uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
+/**
+ * Grow the slots of the path map to keep the load below one half.
+ *
+ * @param map The path map.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_cochange_paths_grow(
+    git2r_cochange_paths *map)
+{
+    size_t i, n_slots = map->n_slots ? 2 * map->n_slots : 1024;
+    size_t *slots = calloc(n_slots, sizeof(size_t));
+
+    if (!slots)
+        goto on_error;
+
+    for (i = 0; i < map->n_paths; i++) {
+        size_t s = git2r_cochange_hash_path(map->paths[i]) & (n_slots - 1);
+
+        while (slots[s])
+            s = (s + 1) & (n_slots - 1);
+        slots[s] = i + 1;
+    }
+
+    free(map->slots);
+    map->slots = slots;
+    map->n_slots = n_slots;
+
+    if (map->n_paths == map->paths_capacity) {
+        size_t capacity = n_slots / 2;
+        char **paths = realloc(map->paths, capacity * sizeof(char *));
+
+        if (!paths)
+            goto on_error;
+        map->paths = paths;
+        map->paths_capacity = capacity;
+    }
+
+    return GIT_OK;
+
+on_error:
+    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+    return GIT_ERROR;
+}
+
+/**
+ * Lookup the index of a path, and add the path if it's not in the
+ * map.
+ *
+ * @param out The index of the path.
+ * @param map The path map.
+ * @param path The path.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_cochange_paths_index(
+    size_t *out,
+    git2r_cochange_paths *map,
+    const char *path)
+{
+    size_t s;
+
+    if (2 * (map->n_paths + 1) > map->n_slots) {
+        int error = git2r_cochange_paths_grow(map);
+        if (error)
+            return error;
+    }
+
+    s = git2r_cochange_hash_path(path) & (map->n_slots - 1);
+    while (map->slots[s]) {
+        if (!strcmp(map->paths[map->slots[s] - 1], path)) {
+            *out = map->slots[s] - 1;
+            return GIT_OK;
+        }
+        s = (s + 1) & (map->n_slots - 1);
+    }
+
+    map->paths[map->n_paths] = malloc(strlen(path) + 1);
+    if (!map->paths[map->n_paths]) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+    strcpy(map->paths[map->n_paths], path);
+    map->slots[s] = map->n_paths + 1;
+    *out = map->n_paths++;
+
+    return GIT_OK;
+}
+
+/**
+ * Add one to the count of a pair of path indices.
+ *
+ * @param map The pair map.
+ * @param key The key of the pair.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_cochange_pairs_add(
+    git2r_cochange_pairs *map,
+    uint64_t key)
+{
+    size_t s;
+
+    if (2 * (map->n_pairs + 1) > map->n_slots) {
+        size_t i, n_slots = map->n_slots ? 2 * map->n_slots : 4096;
+        git2r_cochange_pair *slots = calloc(n_slots, sizeof(git2r_cochange_pair));
+
+        if (!slots) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
+
+        for (i = 0; i < map->n_slots; i++) {
+            if (!map->slots[i].count)
+                continue;
+            s = git2r_cochange_hash_pair(map->slots[i].key) & (n_slots - 1);
+            while (slots[s].count)
+                s = (s + 1) & (n_slots - 1);
+            slots[s] = map->slots[i];
+        }
+
+        free(map->slots);
+        map->slots = slots;
+        map->n_slots = n_slots;
+    }
+
+    s = git2r_cochange_hash_pair(key) & (map->n_slots - 1);
+    while (map->slots[s].count && map->slots[s].key != key)
+        s = (s + 1) & (map->n_slots - 1);
+
+    if (!map->slots[s].count) {
+        map->slots[s].key = key;
+        map->n_pairs++;
+    }
+    map->slots[s].count++;
+
+    return GIT_OK;
+}
+
+/**
+ * Compare two path indices for qsort.
+ */
+static int
+git2r_cochange_cmp_index(
+    const void *a,
+    const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Compare the keys of two pairs for qsort, to order the pairs by the
+ * first and then the second path index.
+ */
+static int
+git2r_cochange_cmp_pair(
+    const void *a,
+    const void *b)
+{
+    uint64_t x = ((const git2r_cochange_pair *)a)->key;
+    uint64_t y = ((const git2r_cochange_pair *)b)->key;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Count the pairs of paths changed in the same commits, also known
+ * as the logical coupling of files.
+ *
+ * Each commit is diffed with its parent tree to tree and only the
+ * paths of the deltas are used, so no blob is read and no patch is
+ * generated. Merge commits are skipped, as with 'git log'.
+ *
+ * @param repo S3 class git_repository
+ * @param commits Character vector with the sha of the commits.
+ * @param path A character vector of paths / fnmatch patterns to
+ * constrain the diff, or R_NilValue for all paths.
+ * @param max_files Skip commits that change more files, or
+ * R_NilValue to use all commits.
+ * @return list with the character vector 'path', in the order the
+ * paths were first seen, and the integer vectors 'i', 'j' and
+ * 'count' with the one-based indices of each pair of paths, i <= j,
+ * and the number of commits that change both. The pairs are ordered
+ * by 'i' and 'j', and 'count' is the number of commits that change
+ * the path when i == j.
+ */
+SEXP attribute_hidden
+git2r_diff_cochange(
+    SEXP repo,
+    SEXP commits,
+    SEXP path,
+    SEXP max_files)
+{
+    int error = GIT_OK, nprotect = 0;
+    size_t i, j, k, n, n_index = 0, index_capacity = 0;
+    size_t *index = NULL, limit = SIZE_MAX;
+    SEXP result = R_NilValue, names, paths, pair_i, pair_j, count;
+    git_oid *oids = NULL;
+    git_strarray pathspec = {NULL, 0};
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    git2r_cochange_paths path_map = {NULL, 0, 0, NULL, 0};
+    git2r_cochange_pairs pair_map = {NULL, 0, 0};
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string_vec(commits))
+        git2r_error(__func__, NULL, "'commits'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(path) && git2r_arg_check_string_vec(path))
+        git2r_error(__func__, NULL, "'path'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(max_files)) {
+        if (git2r_arg_check_integer_gte_zero(max_files))
+            git2r_error(__func__, NULL, "'max_files'",
+                        git2r_err_integer_gte_zero_arg);
+        limit = (size_t)INTEGER(max_files)[0];
+    }
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    n = (size_t)Rf_xlength(commits);
+    error = git2r_diff_commit_oids(&oids, commits);
+    if (error)
+        goto cleanup;
+
+    if (!Rf_isNull(path)) {
+        error = git2r_copy_string_vec(&pathspec, path);
+        if (error)
+            goto cleanup;
+        opts.pathspec = pathspec;
+    }
+    opts.flags |= GIT_DIFF_SKIP_BINARY_CHECK;
+
+    for (k = 0; k < n; k++) {
+        git_diff *diff = NULL;
+        size_t n_deltas;
+
+        error = git2r_diff_commit(&diff, repository, &oids[k], 0, &opts);
+        if (error)
+            goto cleanup;
+        if (!diff)
+            continue;
+
+        n_deltas = git_diff_num_deltas(diff);
+        if (n_deltas > limit) {
+            git_diff_free(diff);
+            continue;
+        }
+
+        if (n_deltas > index_capacity) {
+            size_t *tmp = realloc(index, n_deltas * sizeof(size_t));
+
+            if (!tmp) {
+                git_diff_free(diff);
+                giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+                error = GIT_ERROR;
+                goto cleanup;
+            }
+            index = tmp;
+            index_capacity = n_deltas;
+        }
+
+        for (i = 0; !error && i < n_deltas; i++) {
+            const git_diff_delta *delta = git_diff_get_delta(diff, i);
+            error = git2r_cochange_paths_index(&index[i], &path_map,
+                                               delta->new_file.path);
+        }
+        git_diff_free(diff);
+        if (error)
+            goto cleanup;
+
+        qsort(index, n_deltas, sizeof(size_t), git2r_cochange_cmp_index);
+        for (i = 0, n_index = 0; i < n_deltas; i++) {
+            if (!n_index || index[n_index - 1] != index[i])
+                index[n_index++] = index[i];
+        }
+
+        for (i = 0; i < n_index; i++) {
+            for (j = i; j < n_index; j++) {
+                error = git2r_cochange_pairs_add(
+                    &pair_map, ((uint64_t)index[i] << 32) | index[j]);
+                if (error)
+                    goto cleanup;
+            }
+        }
+    }
+
+    /* Pack the pairs to the start of the slots and sort them. */
+    for (i = 0, j = 0; i < pair_map.n_slots; i++) {
+        if (pair_map.slots[i].count)
+            pair_map.slots[j++] = pair_map.slots[i];
+    }
+    if (pair_map.n_pairs) {
+        qsort(pair_map.slots, pair_map.n_pairs, sizeof(git2r_cochange_pair),
+              git2r_cochange_cmp_pair);
+    }
+
+    PROTECT(result = Rf_allocVector(VECSXP, 4));
+    nprotect++;
+    Rf_setAttrib(result, R_NamesSymbol, names = Rf_allocVector(STRSXP, 4));
+    SET_STRING_ELT(names, 0, Rf_mkChar("path"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("i"));
+    SET_STRING_ELT(names, 2, Rf_mkChar("j"));
+    SET_STRING_ELT(names, 3, Rf_mkChar("count"));
+    SET_VECTOR_ELT(result, 0, paths = Rf_allocVector(STRSXP, path_map.n_paths));
+    SET_VECTOR_ELT(result, 1, pair_i = Rf_allocVector(INTSXP, pair_map.n_pairs));
+    SET_VECTOR_ELT(result, 2, pair_j = Rf_allocVector(INTSXP, pair_map.n_pairs));
+    SET_VECTOR_ELT(result, 3, count = Rf_allocVector(INTSXP, pair_map.n_pairs));
+
+    for (i = 0; i < path_map.n_paths; i++)
+        SET_STRING_ELT(paths, i, Rf_mkCharCE(path_map.paths[i], CE_UTF8));
+
+    for (i = 0; i < pair_map.n_pairs; i++) {
+        INTEGER(pair_i)[i] = (int)(pair_map.slots[i].key >> 32) + 1;
+        INTEGER(pair_j)[i] = (int)(pair_map.slots[i].key & 0xffffffffULL) + 1;
+        INTEGER(count)[i] = (int)pair_map.slots[i].count;
+    }
+
+cleanup:
+    for (i = 0; i < path_map.n_paths; i++)
+        free(path_map.paths[i]);
+    free(path_map.paths);
+    free(path_map.slots);
+    free(pair_map.slots);
+    free(index);
+    free(oids);
+    free(pathspec.strings);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Create the files table of the batch diff.
+ *
+ * @param workers The workers.
+ * @param n_workers The number of workers.
+ * @param commits The sha of the commits.
+ * @param stats Add the number of added and deleted lines.
+ * @return The data.frame, unprotected.
+ */
+static SEXP
+git2r_batch_files_to_r(
+    const git2r_numstat_worker *workers,
+    size_t n_workers,
+    SEXP commits,
+    int stats)
+{
+    static const char *columns[] = {
+        "sha", "old_file", "new_file", "status", "additions", "deletions", ""};
+    static const char *columns_no_stats[] = {
+        "sha", "old_file", "new_file", "status", ""};
+    static const SEXPTYPE types[] = {
+        STRSXP, STRSXP, STRSXP, STRSXP, INTSXP, INTSXP};
+    size_t i, j, n = 0;
+    git2r_diff_table table;
+    SEXP result;
+
+    for (i = 0; i < n_workers; i++)
+        n += workers[i].n_rows;
+
+    PROTECT(result = git2r_diff_table_init(
+                &table, stats ? columns : columns_no_stats, types));
+    git2r_diff_table_reserve(&table, (R_xlen_t)n);
+
+    for (i = 0; i < n_workers; i++) {
+        for (j = 0; j < workers[i].n_rows; j++, table.n++) {
+            const git2r_numstat_row *row = &(workers[i].rows[j]);
+
+            /* The batch workers leave 'renames' at 0, so no file is
+             * renamed and the old path is the path. */
+            SET_STRING_ELT(VECTOR_ELT(result, 0), table.n,
+                           STRING_ELT(commits, row->commit));
+            SET_STRING_ELT(VECTOR_ELT(result, 1), table.n,
+                           Rf_mkCharCE(row->old_path ? row->old_path : row->path,
+                                       CE_UTF8));
+            SET_STRING_ELT(VECTOR_ELT(result, 2), table.n,
+                           Rf_mkCharCE(row->path, CE_UTF8));
+            SET_STRING_ELT(VECTOR_ELT(result, 3), table.n,
+                           Rf_mkChar(git2r_diff_status_name(row->status)));
+            if (stats) {
+                INTEGER(VECTOR_ELT(result, 4))[table.n] =
+                    row->additions < 0 ? NA_INTEGER : row->additions;
+                INTEGER(VECTOR_ELT(result, 5))[table.n] =
+                    row->deletions < 0 ? NA_INTEGER : row->deletions;
+            }
+        }
+    }
+
+    git2r_diff_table_finish(&table);
+    UNPROTECT(1);
+
+    return result;
+}
+
+/**
+ * Create the hunks and the lines tables of the batch diff from the
+ * patches of the workers. The file and hunk keys are one-based
+ * indices in the tables of all workers.
+ *
+ * @param dest The list to save the hunks and lines tables in.
+ * @param workers The workers.
+ * @param n_workers The number of workers.
+ * @return 0 if OK, else error code
+ */
+static int
+git2r_batch_hunks_to_r(
+    SEXP dest,
+    const git2r_numstat_worker *workers,
+    size_t n_workers)
+{
+    int error = GIT_OK;
+    size_t i, j, file = 0;
+    git2r_diff_table hunks, lines;
+
+    SET_VECTOR_ELT(dest, 1, git2r_diff_table_init(
+                       &hunks, git2r_diff_hunk_columns, git2r_diff_hunk_types));
+    SET_VECTOR_ELT(dest, 2, git2r_diff_table_init(
+                       &lines, git2r_diff_line_columns, git2r_diff_line_types));
+
+    for (i = 0; !error && i < n_workers; i++) {
+        for (j = 0; !error && j < workers[i].n_rows; j++) {
+            file++;
+            if (workers[i].rows[j].patch) {
+                error = git2r_diff_patch_to_columns(
+                    &hunks, &lines, workers[i].rows[j].patch, (int)file);
+            }
+        }
+    }
+
+    git2r_diff_table_finish(&hunks);
+    git2r_diff_table_finish(&lines);
+
+    return error;
+}
+
+/**
+ * Diff many commits with their first parent, or with explicit old
+ * trees, on a pool of threads.
+ *
+ * The commits are diffed by the numstat workers, that keep the
+ * patches for the hunks and lines tables.
+ *
+ * @param repo S3 class git_repository
+ * @param commits Character vector with the sha of the commits, or of
+ * commits or trees if 'old' is not R_NilValue.
+ * @param old Character vector with the sha of the old commit or tree
+ * of each commit, or R_NilValue to diff with the first parent of
+ * each commit. A root commit is diffed with the empty tree.
+ * @param path A character vector of paths / fnmatch patterns to
+ * constrain the diff, or R_NilValue for all paths.
+ * @param context_lines The number of unchanged lines that define the
+ * boundary of a hunk.
+ * @param interhunk_lines The maximum number of unchanged lines
+ * between hunk boundaries before the hunks will be merged into one.
+ * @param stats If TRUE, count the added and deleted lines of each
+ * file, else save the hunks and lines.
+ * @param threads The number of threads. One thread is used if
+ * libgit2 is built without thread support.
+ * @return list with the 'files' table, and the 'hunks' and 'lines'
+ * tables unless stats is TRUE.
+ */
+SEXP attribute_hidden
+git2r_diff_batch(
+    SEXP repo,
+    SEXP commits,
+    SEXP old,
+    SEXP path,
+    SEXP context_lines,
+    SEXP interhunk_lines,
+    SEXP stats,
+    SEXP threads)
+{
+    int error = GIT_OK, nprotect = 0, c_stats;
+    size_t i, n, n_threads = 0;
+    SEXP result = R_NilValue, names;
+    git_oid *oids = NULL, *old_oids = NULL;
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    git2r_numstat_worker *workers = NULL;
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string_vec(commits))
+        git2r_error(__func__, NULL, "'commits'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(old) &&
+        (git2r_arg_check_string_vec(old) ||
+         Rf_xlength(old) != Rf_xlength(commits)))
+        git2r_error(__func__, NULL, git2r_err_diff_arg, NULL);
+    if (!Rf_isNull(path) && git2r_arg_check_string_vec(path))
+        git2r_error(__func__, NULL, "'path'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_integer_gte_zero(context_lines))
+        git2r_error(__func__, NULL, "'context_lines'", git2r_err_integer_gte_zero_arg);
+    if (git2r_arg_check_integer_gte_zero(interhunk_lines))
+        git2r_error(__func__, NULL, "'interhunk_lines'", git2r_err_integer_gte_zero_arg);
+    if (git2r_arg_check_logical(stats))
+        git2r_error(__func__, NULL, "'stats'", git2r_err_logical_arg);
+    if (git2r_arg_check_integer_gte_zero(threads))
+        git2r_error(__func__, NULL, "'threads'", git2r_err_integer_gte_zero_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    n = (size_t)Rf_xlength(commits);
+    c_stats = LOGICAL(stats)[0];
+    opts.context_lines = INTEGER(context_lines)[0];
+    opts.interhunk_lines = INTEGER(interhunk_lines)[0];
+    if (!Rf_isNull(path)) {
+        error = git2r_copy_string_vec(&(opts.pathspec), path);
+        if (error)
+            goto cleanup;
+    }
+
+    error = git2r_diff_commit_oids(&oids, commits);
+    if (!error && !Rf_isNull(old))
+        error = git2r_diff_commit_oids(&old_oids, old);
+    if (error)
+        goto cleanup;
+
+    n_threads = git2r_thread_count(INTEGER(threads)[0], n);
+
+    workers = calloc(n_threads, sizeof(git2r_numstat_worker));
+    if (!workers) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    for (i = 0; i < n_threads; i++) {
+        workers[i].oids = oids;
+        workers[i].old = old_oids;
+        workers[i].opts = &opts;
+        workers[i].merges = 1;
+        workers[i].patches = !c_stats;
+    }
+
+    error = git2r_diff_workers_run(workers, n_threads,
+                                   sizeof(git2r_numstat_worker), repository,
+                                   n, git2r_numstat_commit);
+    if (error)
+        goto cleanup;
+
+    PROTECT(result = Rf_allocVector(VECSXP, c_stats ? 1 : 3));
+    nprotect++;
+    Rf_setAttrib(result, R_NamesSymbol,
+                 names = Rf_allocVector(STRSXP, c_stats ? 1 : 3));
+    SET_STRING_ELT(names, 0, Rf_mkChar("files"));
+    SET_VECTOR_ELT(result, 0, git2r_batch_files_to_r(workers, n_threads,
+                                                     commits, c_stats));
+    if (!c_stats) {
+        SET_STRING_ELT(names, 1, Rf_mkChar("hunks"));
+        SET_STRING_ELT(names, 2, Rf_mkChar("lines"));
+        error = git2r_batch_hunks_to_r(result, workers, n_threads);
+    }
+
+cleanup:
+    git2r_numstat_workers_free(workers, n_threads);
+    free(oids);
+    free(old_oids);
+    free(opts.pathspec.strings);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
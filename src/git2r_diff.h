@@ -31,6 +31,38 @@ SEXP git2r_diff(
     SEXP new_prefix,
     SEXP id_abbrev,
     SEXP path,
-    SEXP max_size);
+    SEXP max_size,
+    SEXP format);
+
+SEXP git2r_diff_batch(
+    SEXP repo,
+    SEXP commits,
+    SEXP old,
+    SEXP path,
+    SEXP context_lines,
+    SEXP interhunk_lines,
+    SEXP stats,
+    SEXP threads);
+
+SEXP git2r_diff_cochange(
+    SEXP repo,
+    SEXP commits,
+    SEXP path,
+    SEXP max_files);
+
+SEXP git2r_diff_numstat(
+    SEXP repo,
+    SEXP commits,
+    SEXP path,
+    SEXP renames,
+    SEXP threads);
+
+SEXP git2r_diff_pickaxe(
+    SEXP repo,
+    SEXP commits,
+    SEXP pattern,
+    SEXP regex_fun,
+    SEXP path,
+    SEXP threads);
 
 #endif
@@ -25,18 +25,29 @@
  */
 
 const char git2r_err_alloc_memory_buffer[] = "Unable to allocate memory buffer";
+const char git2r_err_bloom_index_write[] =
+    "Unable to write the changed-path Bloom filter index";
 const char git2r_err_branch_not_local[] = "'branch' is not local";
 const char git2r_err_branch_not_remote[] = "'branch' is not remote";
 const char git2r_err_checkout_tree[] = "Expected commit, tag or tree";
+const char git2r_err_commit_graph_libgit2[] =
+    "Writing a commit-graph requires libgit2 >= 1.2";
+const char git2r_err_commit_header[] = "Unable to parse the commit header";
+const char git2r_err_diff_write[] =
+    "Error writing the diff";
 const char git2r_err_invalid_refname[] = "Invalid reference name";
 const char git2r_err_invalid_remote[] = "Invalid remote name";
 const char git2r_err_invalid_repository[] = "Invalid repository";
 const char git2r_err_nothing_added_to_commit[] = "Nothing added to commit";
 const char git2r_err_object_type[] = "Unexpected object type.";
+const char git2r_err_pickaxe_regex[] =
+    "Unable to match the changed lines with the regular expression";
 const char git2r_err_reference[] = "Unexpected reference type";
 const char git2r_err_repo_init[] = "Unable to init repository";
 const char git2r_err_revparse_not_found[] = "Requested object could not be found";
 const char git2r_err_revparse_single[] = "Expected commit, tag or tree";
+const char git2r_err_revwalk_grep[] =
+    "Unable to match the commit messages with 'grep'";
 const char git2r_err_ssl_cert_locations[] =
     "Either 'filename' or 'path' may be 'NULL', but not both";
 const char git2r_err_unexpected_config_level[] = "Unexpected config level";
@@ -60,10 +71,14 @@ const char git2r_err_proxy_arg[] =
     "must be either 1) NULL, or 2) TRUE or 3) a character vector";
 const char git2r_err_diff_arg[] =
     "Invalid diff parameters";
+const char git2r_err_diff_format_arg[] =
+    "must be a diff format: 'git_diff', 'columnar', 'stats' or 'name_status'";
 const char git2r_err_fetch_heads_arg[] =
     "must be a list of S3 git_fetch_head objects";
 const char git2r_err_filename_arg[] =
-    "must be either 1) NULL, or 2) a character vector of length 0 or 3) a character vector of length 1 and nchar > 0";
+    "must be either 1) NULL, or 2) a character vector of length 0 or 3) a character vector of length 1 and nchar > 0 or 4) a function";
+const char git2r_err_function_arg[] =
+    "must be a function";
 const char git2r_err_sha_arg[] =
     "must be a sha value";
 const char git2r_err_integer_arg[] =
@@ -78,6 +93,10 @@ const char git2r_err_note_arg[] =
     "must be an S3 class git_note";
 const char git2r_err_signature_arg[] =
     "must be an S3 class git_signature";
+const char git2r_err_revwalk_columns_arg[] =
+    "must be a character vector with unique commit log columns";
+const char git2r_err_revwalk_filter_arg[] =
+    "must be a list with the revwalk filter";
 const char git2r_err_string_arg[] =
     "must be a character vector of length one with non NA value";
 const char git2r_err_string_vec_arg[] =
@@ -25,18 +25,24 @@
  * Error messages
  */
 extern const char git2r_err_alloc_memory_buffer[];
+extern const char git2r_err_bloom_index_write[];
 extern const char git2r_err_branch_not_local[];
 extern const char git2r_err_branch_not_remote[];
 extern const char git2r_err_checkout_tree[];
+extern const char git2r_err_commit_graph_libgit2[];
+extern const char git2r_err_commit_header[];
+extern const char git2r_err_diff_write[];
 extern const char git2r_err_invalid_refname[];
 extern const char git2r_err_invalid_remote[];
 extern const char git2r_err_invalid_repository[];
 extern const char git2r_err_nothing_added_to_commit[];
 extern const char git2r_err_object_type[];
+extern const char git2r_err_pickaxe_regex[];
 extern const char git2r_err_reference[];
 extern const char git2r_err_repo_init[];
 extern const char git2r_err_revparse_not_found[];
 extern const char git2r_err_revparse_single[];
+extern const char git2r_err_revwalk_grep[];
 extern const char git2r_err_ssl_cert_locations[];
 extern const char git2r_err_unexpected_config_level[];
 extern const char git2r_err_unable_to_authenticate[];
@@ -52,8 +58,10 @@ extern const char git2r_err_commit_stash_arg[];
 extern const char git2r_err_credentials_arg[];
 extern const char git2r_err_proxy_arg[];
 extern const char git2r_err_diff_arg[];
+extern const char git2r_err_diff_format_arg[];
 extern const char git2r_err_fetch_heads_arg[];
 extern const char git2r_err_filename_arg[];
+extern const char git2r_err_function_arg[];
 extern const char git2r_err_sha_arg[];
 extern const char git2r_err_integer_arg[];
 extern const char git2r_err_integer_gte_zero_arg[];
@@ -61,6 +69,8 @@ extern const char git2r_err_list_arg[];
 extern const char git2r_err_logical_arg[];
 extern const char git2r_err_note_arg[];
 extern const char git2r_err_signature_arg[];
+extern const char git2r_err_revwalk_columns_arg[];
+extern const char git2r_err_revwalk_filter_arg[];
 extern const char git2r_err_string_arg[];
 extern const char git2r_err_string_vec_arg[];
 extern const char git2r_err_tag_arg[];
@@ -18,10 +18,17 @@
 
 #include <R_ext/Visibility.h>
 #include <git2.h>
+#if LIBGIT2_VER_MAJOR > 1 || LIBGIT2_VER_MINOR >= 2
+#include <git2/sys/commit_graph.h>
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "git2r_arg.h"
 #include "git2r_error.h"
 #include "git2r_oid.h"
+#include "git2r_oidmap.h"
 #include "git2r_repository.h"
 #include "git2r_S3.h"
 
@@ -77,7 +84,493 @@ git2r_graph_ahead_behind(
     INTEGER(result)[1] = behind;
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * State of the walk to count ahead and behind for many pairs of
+ * commits at once.
+ *
+ * Each commit in the walk has a bitmap with one bit for each tip,
+ * i.e. each distinct local or upstream commit, that can reach the
+ * commit. The commit is ahead in a pair if the bit of the local
+ * commit is set but not the bit of the upstream commit, and vice
+ * versa for behind.
+ */
+typedef struct {
+    git2r_oidmap map;
+    uint64_t *bits;
+    size_t n;
+    size_t capacity;
+    size_t words;
+    size_t pending;
+} git2r_ahead_behind_walk;
+
+#define GIT2R_BIT_IS_SET(bits, i) (((bits)[(i) / 64] >> ((i) % 64)) & 1)
+
+/**
+ * Check if all tips can reach a commit.
+ */
+static int
+git2r_ahead_behind_is_full(
+    const uint64_t *bits,
+    size_t n_tips)
+{
+    size_t i;
+
+    for (i = 0; i < n_tips / 64; i++) {
+        if (bits[i] != UINT64_MAX)
+            return 0;
+    }
+
+    if (n_tips % 64)
+        return bits[i] == (UINT64_MAX >> (64 - n_tips % 64));
+
+    return 1;
+}
+
+/**
+ * Find the bitmap of a commit, and add the commit with an empty
+ * bitmap if it is not already in the walk.
+ *
+ * @param out The index of the bitmap of the commit.
+ * @param walk The walk.
+ * @param oid The id of the commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_ahead_behind_get(
+    size_t *out,
+    git2r_ahead_behind_walk *walk,
+    const git_oid *oid)
+{
+    int error;
+
+    if (git2r_oidmap_get(out, &(walk->map), oid))
+        return GIT_OK;
+
+    if (walk->n == walk->capacity) {
+        size_t capacity = walk->capacity ? 2 * walk->capacity : 1024;
+        uint64_t *bits = realloc(
+            walk->bits, capacity * walk->words * sizeof(uint64_t));
+
+        if (!bits) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
+        walk->bits = bits;
+        walk->capacity = capacity;
+    }
+
+    memset(walk->bits + walk->n * walk->words, 0,
+           walk->words * sizeof(uint64_t));
+    error = git2r_oidmap_put(&(walk->map), oid, walk->n);
+    if (error)
+        return error;
+    *out = walk->n++;
+    walk->pending++;
+
+    return GIT_OK;
+}
+
+/**
+ * Count the number of unique commits between many pairs of commits
+ *
+ * All pairs are counted in one walk of the history. The commits are
+ * walked in topological order, so the bitmap of a commit is
+ * complete when the commit is reached, and its bitmap is then added
+ * to the bitmaps of its parents. The walk stops when all the
+ * remaining commits can be reached from every tip, since they can
+ * not change the counts.
+ *
+ * @param repo S3 class git_repository
+ * @param local Character vector with the sha of the local commits.
+ * @param upstream Character vector with the sha of the upstream
+ * commits. Must have the same length as 'local'.
+ * @return Integer matrix with the number of commits ahead in the
+ * first column, and the number of commits behind in the second
+ * column, for each pair of commits.
+ */
+SEXP attribute_hidden
+git2r_graph_ahead_behind_matrix(
+    SEXP repo,
+    SEXP local,
+    SEXP upstream)
+{
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    size_t i, n_pairs, n_tips = 0;
+    size_t *local_tip = NULL, *upstream_tip = NULL;
+    int *counts;
+    uint64_t *full = NULL;
+    git_oid oid;
+    git2r_ahead_behind_walk walk = {{NULL, NULL, 0, 0}, NULL, 0, 0, 0, 0};
+    git_revwalk *walker = NULL;
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string_vec(local))
+        git2r_error(__func__, NULL, "'local'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_string_vec(upstream))
+        git2r_error(__func__, NULL, "'upstream'", git2r_err_string_vec_arg);
+    if (Rf_xlength(local) != Rf_xlength(upstream))
+        git2r_error(__func__, NULL,
+                    "'local' and 'upstream' must have the same length", NULL);
+
+    n_pairs = Rf_xlength(local);
+    for (i = 0; i < n_pairs; i++) {
+        if (STRING_ELT(local, i) == NA_STRING)
+            git2r_error(__func__, NULL, "'local'", git2r_err_sha_arg);
+        if (STRING_ELT(upstream, i) == NA_STRING)
+            git2r_error(__func__, NULL, "'upstream'", git2r_err_sha_arg);
+    }
+
+    PROTECT(result = Rf_allocMatrix(INTSXP, n_pairs, 2));
+    nprotect++;
+    counts = INTEGER(result);
+    for (i = 0; i < 2 * n_pairs; i++)
+        counts[i] = 0;
+    if (!n_pairs)
+        goto cleanup;
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    local_tip = malloc(n_pairs * sizeof(size_t));
+    upstream_tip = malloc(n_pairs * sizeof(size_t));
+    if (!local_tip || !upstream_tip) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    error = git_revwalk_new(&walker, repository);
+    if (error)
+        goto cleanup;
+    git_revwalk_sorting(walker, GIT_SORT_TOPOLOGICAL);
+
+    /* Find the distinct tips. The index of a tip in the walk is also
+     * its bit in the bitmaps. */
+    walk.words = (2 * n_pairs + 63) / 64;
+    for (i = 0; i < 2 * n_pairs; i++) {
+        SEXP sha = (i < n_pairs) ?
+            STRING_ELT(local, i) : STRING_ELT(upstream, i - n_pairs);
+        size_t *tip = (i < n_pairs) ?
+            &local_tip[i] : &upstream_tip[i - n_pairs];
+
+        error = git_oid_fromstr(&oid, CHAR(sha));
+        if (error)
+            goto cleanup;
+        error = git2r_ahead_behind_get(tip, &walk, &oid);
+        if (error)
+            goto cleanup;
+        if (*tip == n_tips) {
+            n_tips++;
+            error = git_revwalk_push(walker, &oid);
+            if (error)
+                goto cleanup;
+        }
+    }
+
+    for (i = 0; i < n_tips; i++)
+        walk.bits[i * walk.words + i / 64] |= (uint64_t)1 << (i % 64);
+    for (i = 0; i < n_tips; i++) {
+        if (git2r_ahead_behind_is_full(walk.bits + i * walk.words, n_tips))
+            walk.pending--;
+    }
+
+    full = malloc(walk.words * sizeof(uint64_t));
+    if (!full) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    while (walk.pending && !(error = git_revwalk_next(&oid, walker))) {
+        size_t index, j;
+        unsigned int k, parentcount;
+        git_commit *commit;
+
+        if (!git2r_oidmap_get(&index, &(walk.map), &oid))
+            continue;
+
+        /* Copy the bitmap, since adding parents can move the
+         * bitmaps. */
+        memcpy(full, walk.bits + index * walk.words,
+               walk.words * sizeof(uint64_t));
+        if (!git2r_ahead_behind_is_full(full, n_tips)) {
+            walk.pending--;
+            for (j = 0; j < n_pairs; j++) {
+                int l = GIT2R_BIT_IS_SET(full, local_tip[j]);
+                int u = GIT2R_BIT_IS_SET(full, upstream_tip[j]);
+
+                if (l && !u)
+                    counts[j]++;
+                else if (u && !l)
+                    counts[j + n_pairs]++;
+            }
+        }
+
+        error = git_commit_lookup(&commit, repository, &oid);
+        if (error)
+            goto cleanup;
+        parentcount = git_commit_parentcount(commit);
+        for (k = 0; k < parentcount; k++) {
+            uint64_t *bits;
+            int was_full;
+
+            error = git2r_ahead_behind_get(
+                &index, &walk, git_commit_parent_id(commit, k));
+            if (error)
+                break;
+
+            bits = walk.bits + index * walk.words;
+            was_full = git2r_ahead_behind_is_full(bits, n_tips);
+            for (j = 0; j < walk.words; j++)
+                bits[j] |= full[j];
+            if (!was_full && git2r_ahead_behind_is_full(bits, n_tips))
+                walk.pending--;
+        }
+        git_commit_free(commit);
+        if (error)
+            goto cleanup;
+    }
+
+    if (GIT_ITEROVER == error)
+        error = GIT_OK;
+
+cleanup:
+    free(full);
+    free(local_tip);
+    free(upstream_tip);
+    free(walk.bits);
+    git2r_oidmap_free(&(walk.map));
+    git_revwalk_free(walker);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * The commits reachable from a set of tips, saved between calls
+ * until the tips move.
+ */
+static struct {
+    char *path;
+    git_oid *tips;
+    size_t n_tips;
+    git2r_oidmap reachable;
+} git2r_reachable_cache = {NULL, NULL, 0, {NULL, NULL, 0, 0}};
+
+/**
+ * Free the saved set of reachable commits.
+ *
+ * @return void
+ */
+void attribute_hidden
+git2r_graph_reachable_cache_clear(void)
+{
+    free(git2r_reachable_cache.path);
+    free(git2r_reachable_cache.tips);
+    git2r_oidmap_free(&(git2r_reachable_cache.reachable));
+    git2r_reachable_cache.path = NULL;
+    git2r_reachable_cache.tips = NULL;
+    git2r_reachable_cache.n_tips = 0;
+}
+
+static int
+git2r_oid_cmp_qsort(
+    const void *a,
+    const void *b)
+{
+    return git_oid_cmp((const git_oid *)a, (const git_oid *)b);
+}
+
+/**
+ * Check if the saved set of reachable commits is for the tips.
+ *
+ * @param path The path of the repository.
+ * @param tips The sorted ids of the tips.
+ * @param n_tips The number of tips.
+ * @return 1 if the saved set is for the tips, else 0.
+ */
+static int
+git2r_reachable_cache_match(
+    const char *path,
+    const git_oid *tips,
+    size_t n_tips)
+{
+    size_t i;
+
+    if (!git2r_reachable_cache.path ||
+        strcmp(git2r_reachable_cache.path, path) ||
+        git2r_reachable_cache.n_tips != n_tips)
+        return 0;
+
+    for (i = 0; i < n_tips; i++) {
+        if (!git_oid_equal(&(git2r_reachable_cache.tips[i]), &tips[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Determine if commits are reachable from a set of tips
+ *
+ * The commits reachable from the tips are found in one walk of the
+ * history, and each commit is then looked up in the set of
+ * reachable commits.
+ *
+ * @param repo S3 class git_repository
+ * @param tips Character vector with the sha of the tips.
+ * @param sha Character vector with the sha of the commits to check.
+ * @param cache Save the set of reachable commits, and reuse it in
+ * the next call with the same repository and tips.
+ * @return Logical vector, TRUE if the commit is one of the tips or
+ * an ancestor of one of the tips, else FALSE.
+ */
+SEXP attribute_hidden
+git2r_graph_reachable(
+    SEXP repo,
+    SEXP tips,
+    SEXP sha,
+    SEXP cache)
+{
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    size_t i, n, n_tips = 0;
+    const char *path;
+    git_oid oid, *tip_oids = NULL;
+    git2r_oidmap walked = {NULL, NULL, 0, 0};
+    const git2r_oidmap *reachable = &walked;
+    git_revwalk *walker = NULL;
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string_vec(tips))
+        git2r_error(__func__, NULL, "'tips'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_string_vec(sha))
+        git2r_error(__func__, NULL, "'sha'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_logical(cache))
+        git2r_error(__func__, NULL, "'cache'", git2r_err_logical_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    n = Rf_xlength(tips);
+    if (n) {
+        tip_oids = malloc(n * sizeof(git_oid));
+        if (!tip_oids) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            error = GIT_ERROR;
+            goto cleanup;
+        }
+    }
+
+    /* Sort the tips and drop duplicates, to compare with the saved
+     * tips. */
+    for (i = 0; i < n; i++) {
+        if (STRING_ELT(tips, i) == NA_STRING)
+            continue;
+        error = git_oid_fromstr(&tip_oids[n_tips], CHAR(STRING_ELT(tips, i)));
+        if (error)
+            goto cleanup;
+        n_tips++;
+    }
+    if (n_tips)
+        qsort(tip_oids, n_tips, sizeof(git_oid), git2r_oid_cmp_qsort);
+    for (i = 1, n = n_tips ? 1 : 0; i < n_tips; i++) {
+        if (!git_oid_equal(&tip_oids[i], &tip_oids[n - 1]))
+            git_oid_cpy(&tip_oids[n++], &tip_oids[i]);
+    }
+    n_tips = n;
+
+    path = git_repository_path(repository);
+    if (LOGICAL(cache)[0] &&
+        git2r_reachable_cache_match(path, tip_oids, n_tips)) {
+        reachable = &(git2r_reachable_cache.reachable);
+    } else {
+        error = git_revwalk_new(&walker, repository);
+        if (error)
+            goto cleanup;
+        for (i = 0; i < n_tips; i++) {
+            error = git_revwalk_push(walker, &tip_oids[i]);
+            if (error)
+                goto cleanup;
+        }
+
+        while (n_tips && !(error = git_revwalk_next(&oid, walker))) {
+            error = git2r_oidmap_put(&walked, &oid, 0);
+            if (error)
+                goto cleanup;
+        }
+        if (GIT_ITEROVER == error)
+            error = GIT_OK;
+        if (error)
+            goto cleanup;
+
+        if (LOGICAL(cache)[0]) {
+            char *cache_path = malloc(strlen(path) + 1);
+
+            if (!cache_path) {
+                giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+                error = GIT_ERROR;
+                goto cleanup;
+            }
+            strcpy(cache_path, path);
+
+            /* Move the set of reachable commits to the cache. */
+            git2r_graph_reachable_cache_clear();
+            git2r_reachable_cache.path = cache_path;
+            git2r_reachable_cache.tips = tip_oids;
+            git2r_reachable_cache.n_tips = n_tips;
+            git2r_reachable_cache.reachable = walked;
+            tip_oids = NULL;
+            walked.keys = NULL;
+            walked.values = NULL;
+            walked.size = 0;
+            walked.capacity = 0;
+            reachable = &(git2r_reachable_cache.reachable);
+        }
+    }
+
+    n = Rf_xlength(sha);
+    PROTECT(result = Rf_allocVector(LGLSXP, n));
+    nprotect++;
+    for (i = 0; i < n; i++) {
+        size_t value;
+
+        if (STRING_ELT(sha, i) == NA_STRING) {
+            LOGICAL(result)[i] = NA_LOGICAL;
+            continue;
+        }
+
+        error = git_oid_fromstr(&oid, CHAR(STRING_ELT(sha, i)));
+        if (error)
+            goto cleanup;
+        LOGICAL(result)[i] = git2r_oidmap_get(&value, reachable, &oid);
+    }
+
+cleanup:
+    free(tip_oids);
+    git2r_oidmap_free(&walked);
+    git_revwalk_free(walker);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -133,10 +626,114 @@ git2r_graph_descendant_of(
     error = 0;
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
 
     return Rf_ScalarLogical(descendant_of);
 }
+
+/**
+ * Write a commit-graph file for the commits reachable from the
+ * references and HEAD in the repository.
+ *
+ * The commit-graph file '.git/objects/info/commit-graph' stores the
+ * parents and generation number of each commit in one compact
+ * index. When the file exists, libgit2 reads the commits from it
+ * instead of parsing the commit objects in the object database
+ * during the revision walk and graph queries.
+ *
+ * @param repo S3 class git_repository
+ * @return The path to the commit-graph file, or R_NilValue if the
+ * repository is empty.
+ */
+SEXP attribute_hidden
+git2r_graph_commit_graph_write(
+    SEXP repo)
+{
+#if LIBGIT2_VER_MAJOR > 1 || LIBGIT2_VER_MINOR >= 2
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    char *info_dir = NULL;
+    const char *commondir;
+    git_revwalk *walker = NULL;
+    git_commit_graph_writer *writer = NULL;
+    git_repository *repository = NULL;
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    if (git_repository_is_empty(repository))
+        goto cleanup;
+
+    commondir = git_repository_commondir(repository);
+    info_dir = malloc(strlen(commondir) + strlen("objects/info/commit-graph") + 1);
+    if (!info_dir) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+    strcpy(info_dir, commondir);
+    strcat(info_dir, "objects/info");
+
+    error = git_revwalk_new(&walker, repository);
+    if (error)
+        goto cleanup;
+    error = git_revwalk_push_glob(walker, "refs/*");
+    if (error)
+        goto cleanup;
+    if (!git_repository_head_unborn(repository)) {
+        error = git_revwalk_push_head(walker);
+        if (error)
+            goto cleanup;
+    }
+
+#if LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR < 9
+    error = git_commit_graph_writer_new(&writer, info_dir);
+#else
+    error = git_commit_graph_writer_new(&writer, info_dir, NULL);
+#endif
+    if (error)
+        goto cleanup;
+
+    error = git_commit_graph_writer_add_revwalk(writer, walker);
+    if (error)
+        goto cleanup;
+
+#if LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR < 9
+    {
+        git_commit_graph_writer_options opts =
+            GIT_COMMIT_GRAPH_WRITER_OPTIONS_INIT;
+        error = git_commit_graph_writer_commit(writer, &opts);
+    }
+#else
+    error = git_commit_graph_writer_commit(writer);
+#endif
+    if (error)
+        goto cleanup;
+
+    strcat(info_dir, "/commit-graph");
+    PROTECT(result = Rf_mkString(info_dir));
+    nprotect++;
+
+cleanup:
+    git_commit_graph_writer_free(writer);
+    git_revwalk_free(walker);
+    free(info_dir);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+#else
+    GIT2R_UNUSED(repo);
+    git2r_error(__func__, NULL, git2r_err_commit_graph_libgit2, NULL);
+    return R_NilValue;
+#endif
+}
@@ -23,6 +23,10 @@
 #include <Rinternals.h>
 
 SEXP git2r_graph_ahead_behind(SEXP local, SEXP upstream);
+SEXP git2r_graph_ahead_behind_matrix(SEXP repo, SEXP local, SEXP upstream);
+SEXP git2r_graph_commit_graph_write(SEXP repo);
 SEXP git2r_graph_descendant_of(SEXP commit, SEXP ancestor);
+SEXP git2r_graph_reachable(SEXP repo, SEXP tips, SEXP sha, SEXP cache);
+void git2r_graph_reachable_cache_clear(void);
 
 #endif
@@ -74,7 +74,7 @@ git2r_index_add_all(
 cleanup:
     free(pathspec.strings);
     git_index_free(index);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -127,7 +127,7 @@ git2r_index_remove_bypath(
 
 cleanup:
     git_index_free(index);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
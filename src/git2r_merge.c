@@ -100,7 +100,7 @@ git2r_merge_base(
 
 cleanup:
     git_commit_free(commit);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -594,7 +594,7 @@ cleanup:
     git_signature_free(who);
     git2r_merge_heads_free(merge_heads, 1);
     git_reference_free(reference);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -725,7 +725,7 @@ git2r_merge_fetch_heads(
 cleanup:
     git_signature_free(who);
     git2r_merge_heads_free(merge_heads, n);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
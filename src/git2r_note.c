@@ -186,7 +186,7 @@ git2r_note_create(
 cleanup:
     git_signature_free(sig_author);
     git_signature_free(sig_committer);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -228,7 +228,7 @@ git2r_note_default_ref(
 
 cleanup:
     git_buf_dispose(&buf);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -353,7 +353,7 @@ git2r_notes(
 
 cleanup:
     git_buf_dispose(&buf);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -421,7 +421,7 @@ git2r_note_remove(
 cleanup:
     git_signature_free(sig_author);
     git_signature_free(sig_committer);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -102,7 +102,7 @@ git2r_object_lookup(
 
 cleanup:
     git_object_free(object);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
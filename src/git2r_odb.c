@@ -251,7 +251,7 @@ git2r_odb_objects(
     error = git_odb_foreach(odb, &git2r_odb_objects_cb, &cb_data);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     git_odb_free(odb);
 
     if (nprotect)
@@ -545,7 +545,7 @@ git2r_odb_blobs(
     error = git_odb_foreach(odb, &git2r_odb_blobs_cb, &cb_data);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     git_odb_free(odb);
 
     if (nprotect)
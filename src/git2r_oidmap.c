@@ -0,0 +1,172 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2026 The git2r contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2,
+ *  as published by the Free Software Foundation.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <R_ext/Visibility.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "git2r_error.h"
+#include "git2r_oidmap.h"
+
+/* An unused slot in the map has the value 0, so the stored values
+ * are offset by one. */
+#define GIT2R_OIDMAP_EMPTY 0
+
+/**
+ * The slot of an id in the map. The id is a SHA-1 hash, so its
+ * first bytes are already uniformly distributed.
+ */
+static size_t
+git2r_oidmap_hash(
+    const git_oid *oid)
+{
+    size_t h;
+
+    memcpy(&h, oid->id, sizeof(h));
+
+    return h;
+}
+
+/**
+ * Find the slot of an id, or the empty slot where it should be
+ * inserted.
+ */
+static size_t
+git2r_oidmap_slot(
+    const git2r_oidmap *map,
+    const git_oid *oid)
+{
+    size_t mask = map->capacity - 1;
+    size_t i = git2r_oidmap_hash(oid) & mask;
+
+    while (map->values[i] != GIT2R_OIDMAP_EMPTY &&
+           !git_oid_equal(&(map->keys[i]), oid))
+        i = (i + 1) & mask;
+
+    return i;
+}
+
+static int
+git2r_oidmap_grow(
+    git2r_oidmap *map)
+{
+    size_t i, capacity = map->capacity ? 2 * map->capacity : 1024;
+    git2r_oidmap grown = {NULL, NULL, 0, 0};
+
+    grown.keys = malloc(capacity * sizeof(git_oid));
+    grown.values = calloc(capacity, sizeof(size_t));
+    if (!grown.keys || !grown.values) {
+        free(grown.keys);
+        free(grown.values);
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+    grown.capacity = capacity;
+    grown.size = map->size;
+
+    for (i = 0; i < map->capacity; i++) {
+        if (map->values[i] != GIT2R_OIDMAP_EMPTY) {
+            size_t j = git2r_oidmap_slot(&grown, &(map->keys[i]));
+            git_oid_cpy(&(grown.keys[j]), &(map->keys[i]));
+            grown.values[j] = map->values[i];
+        }
+    }
+
+    git2r_oidmap_free(map);
+    *map = grown;
+
+    return GIT_OK;
+}
+
+/**
+ * Get the value of an id.
+ *
+ * @param value The value of the id.
+ * @param map The map.
+ * @param oid The id to look up.
+ * @return 1 if the id is in the map, else 0.
+ */
+int attribute_hidden
+git2r_oidmap_get(
+    size_t *value,
+    const git2r_oidmap *map,
+    const git_oid *oid)
+{
+    size_t i;
+
+    if (!map->capacity)
+        return 0;
+
+    i = git2r_oidmap_slot(map, oid);
+    if (map->values[i] == GIT2R_OIDMAP_EMPTY)
+        return 0;
+    *value = map->values[i] - 1;
+
+    return 1;
+}
+
+/**
+ * Set the value of an id.
+ *
+ * @param map The map.
+ * @param oid The id.
+ * @param value The value.
+ * @return 0 on success, or an error code.
+ */
+int attribute_hidden
+git2r_oidmap_put(
+    git2r_oidmap *map,
+    const git_oid *oid,
+    size_t value)
+{
+    size_t i;
+
+    /* Keep the load factor below one half. */
+    if (2 * (map->size + 1) > map->capacity) {
+        int error = git2r_oidmap_grow(map);
+        if (error)
+            return error;
+    }
+
+    i = git2r_oidmap_slot(map, oid);
+    if (map->values[i] == GIT2R_OIDMAP_EMPTY) {
+        git_oid_cpy(&(map->keys[i]), oid);
+        map->size++;
+    }
+    map->values[i] = value + 1;
+
+    return GIT_OK;
+}
+
+/**
+ * Free the memory of a map.
+ *
+ * @param map The map.
+ * @return void
+ */
+void attribute_hidden
+git2r_oidmap_free(
+    git2r_oidmap *map)
+{
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+    map->size = 0;
+    map->capacity = 0;
+}
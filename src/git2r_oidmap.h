@@ -0,0 +1,41 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2026 The git2r contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2,
+ *  as published by the Free Software Foundation.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef INCLUDE_git2r_oidmap_h
+#define INCLUDE_git2r_oidmap_h
+
+#include <git2.h>
+#include <stddef.h>
+
+/**
+ * Hash map from a git_oid to an index, e.g. into an array with
+ * data for each commit. Initialize with all fields zero, i.e.
+ * 'git2r_oidmap map = {NULL, NULL, 0, 0};'.
+ */
+typedef struct {
+    git_oid *keys;
+    size_t *values;
+    size_t size;
+    size_t capacity;
+} git2r_oidmap;
+
+int git2r_oidmap_get(size_t *value, const git2r_oidmap *map, const git_oid *oid);
+int git2r_oidmap_put(git2r_oidmap *map, const git_oid *oid, size_t value);
+void git2r_oidmap_free(git2r_oidmap *map);
+
+#endif
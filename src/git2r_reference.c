@@ -129,7 +129,7 @@ git2r_reference_dwim(
 
 cleanup:
     git_reference_free(reference);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -194,7 +194,7 @@ git2r_reference_list(
 
 cleanup:
     git_strarray_free(&ref_list);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
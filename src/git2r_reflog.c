@@ -154,7 +154,7 @@ git2r_reflog_list(
 
 cleanup:
     git_reflog_free(reflog);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
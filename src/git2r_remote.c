@@ -67,7 +67,7 @@ git2r_remote_add(
         CHAR(STRING_ELT(url, 0)));
 
     git_remote_free(remote);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
 	git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -227,7 +227,7 @@ cleanup:
     if (remote && git_remote_connected(remote))
         git_remote_disconnect(remote);
     git_remote_free(remote);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -273,7 +273,7 @@ git2r_remote_list(
 
 cleanup:
     git_strarray_free(&rem_list);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -310,7 +310,7 @@ git2r_remote_remove(
 
     error = git_remote_delete(repository, CHAR(STRING_ELT(name, 0)));
 
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
 	git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -356,7 +356,7 @@ git2r_remote_rename(
     git_strarray_free(&problems);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
 	git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -397,7 +397,7 @@ git2r_remote_set_url(
         CHAR(STRING_ELT(name, 0)),
         CHAR(STRING_ELT(url, 0)));
 
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
 	git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -453,7 +453,7 @@ git2r_remote_url(
     }
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     UNPROTECT(1);
 
@@ -549,7 +549,7 @@ git2r_remote_ls(
     }
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -18,6 +18,9 @@
 
 #include <R_ext/Visibility.h>
 #include <git2.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "git2r_arg.h"
 #include "git2r_blob.h"
@@ -30,9 +33,155 @@
 #include "git2r_tag.h"
 #include "git2r_tree.h"
 
+/**
+ * Number of repository handles that are kept open in the cache.
+ */
+#define GIT2R_REPOSITORY_CACHE_SIZE 8
+
+/**
+ * Data structure to hold an open repository handle in the cache.
+ */
+typedef struct {
+    char *path;
+    git_repository *repository;
+    unsigned long last_used;
+} git2r_repository_cache_entry;
+
+static git2r_repository_cache_entry
+git2r_repository_cache[GIT2R_REPOSITORY_CACHE_SIZE];
+static unsigned long git2r_repository_cache_tick = 0;
+
+/**
+ * Check if the repository handle cache is enabled, i.e. if the R
+ * option 'git2r.repository_cache' is TRUE.
+ *
+ * @return 1 if enabled, else 0
+ */
+static int
+git2r_repository_cache_enabled(void)
+{
+    SEXP option = Rf_GetOption1(Rf_install("git2r.repository_cache"));
+
+    if (!Rf_isLogical(option) || Rf_length(option) != 1)
+        return 0;
+    return LOGICAL(option)[0] == TRUE;
+}
+
+/**
+ * Close the repository handle in a cache entry and clear the entry.
+ *
+ * @param entry The cache entry to clear.
+ * @return void
+ */
+static void
+git2r_repository_cache_entry_clear(
+    git2r_repository_cache_entry *entry)
+{
+    git_repository_free(entry->repository);
+    free(entry->path);
+    entry->repository = NULL;
+    entry->path = NULL;
+    entry->last_used = 0;
+}
+
+/**
+ * Close all repository handles in the cache.
+ *
+ * @return void
+ */
+void attribute_hidden
+git2r_repository_cache_clear(void)
+{
+    size_t i;
+
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        if (git2r_repository_cache[i].repository)
+            git2r_repository_cache_entry_clear(&git2r_repository_cache[i]);
+    }
+}
+
+/**
+ * Lookup a repository handle in the cache. An entry whose git
+ * directory no longer exists is dropped from the cache.
+ *
+ * @param path The path to the repository.
+ * @return The cached repository handle, or NULL if not found.
+ */
+static git_repository*
+git2r_repository_cache_lookup(
+    const char *path)
+{
+    size_t i;
+
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        git2r_repository_cache_entry *entry = &git2r_repository_cache[i];
+        struct stat sb;
+
+        if (!entry->repository || strcmp(entry->path, path))
+            continue;
+
+        if (stat(git_repository_path(entry->repository), &sb)) {
+            git2r_repository_cache_entry_clear(entry);
+            return NULL;
+        }
+
+        entry->last_used = ++git2r_repository_cache_tick;
+        return entry->repository;
+    }
+
+    return NULL;
+}
+
+/**
+ * Add a repository handle to the cache. If the cache is full, the
+ * least recently used handle is closed to make room for it.
+ *
+ * @param path The path to the repository.
+ * @param repository The repository handle to add.
+ * @return 0 on success, or -1 if the path could not be copied.
+ */
+static int
+git2r_repository_cache_add(
+    const char *path,
+    git_repository *repository)
+{
+    size_t i, slot = 0;
+    char *key;
+
+    key = malloc(strlen(path) + 1);
+    if (!key)
+        return -1;
+    strcpy(key, path);
+
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        if (!git2r_repository_cache[i].repository) {
+            slot = i;
+            break;
+        }
+
+        if (git2r_repository_cache[i].last_used <
+            git2r_repository_cache[slot].last_used)
+            slot = i;
+    }
+
+    if (git2r_repository_cache[slot].repository)
+        git2r_repository_cache_entry_clear(&git2r_repository_cache[slot]);
+
+    git2r_repository_cache[slot].path = key;
+    git2r_repository_cache[slot].repository = repository;
+    git2r_repository_cache[slot].last_used = ++git2r_repository_cache_tick;
+
+    return 0;
+}
+
 /**
  * Get repo from S3 class git_repository
  *
+ * If the R option 'git2r.repository_cache' is TRUE, the opened
+ * repository is kept in a cache keyed by path, and later calls with
+ * the same path reuse the handle. The returned pointer must always be
+ * released with 'git2r_repository_free'.
+ *
  * @param repo S3 class git_repository
  * @return a git_repository pointer on success else NULL
  */
@@ -40,7 +189,7 @@ attribute_hidden git_repository*
 git2r_repository_open(
     SEXP repo)
 {
-    int error;
+    int error, cache;
     SEXP path;
     git_repository *repository = NULL;
 
@@ -50,6 +199,16 @@ git2r_repository_open(
     }
 
     path = git2r_get_list_element(repo, "path");
+
+    cache = git2r_repository_cache_enabled();
+    if (cache) {
+        repository = git2r_repository_cache_lookup(CHAR(STRING_ELT(path, 0)));
+        if (repository)
+            return repository;
+    } else {
+        git2r_repository_cache_clear();
+    }
+
     error = git_repository_open(&repository, CHAR(STRING_ELT(path, 0)));
     if (error) {
         if (error == GIT_ENOTFOUND)
@@ -60,9 +219,71 @@ git2r_repository_open(
         return NULL;
     }
 
+    if (cache)
+        git2r_repository_cache_add(CHAR(STRING_ELT(path, 0)), repository);
+
     return repository;
 }
 
+/**
+ * Release a repository pointer from 'git2r_repository_open'.
+ *
+ * Handles that are kept in the repository cache stay open, other
+ * handles are closed.
+ *
+ * @param repository The repository to release.
+ * @return void
+ */
+void attribute_hidden
+git2r_repository_free(
+    git_repository *repository)
+{
+    size_t i;
+
+    if (!repository)
+        return;
+
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        if (git2r_repository_cache[i].repository == repository)
+            return;
+    }
+
+    git_repository_free(repository);
+}
+
+/**
+ * Close the cached handle of a repository.
+ *
+ * @param repo S3 class git_repository, or R_NilValue to close all
+ * cached repository handles.
+ * @return R_NilValue
+ */
+SEXP attribute_hidden
+git2r_repository_close(
+    SEXP repo)
+{
+    size_t i;
+    SEXP path;
+
+    if (Rf_isNull(repo)) {
+        git2r_repository_cache_clear();
+        return R_NilValue;
+    }
+
+    if (git2r_arg_check_repository(repo))
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    path = git2r_get_list_element(repo, "path");
+    for (i = 0; i < GIT2R_REPOSITORY_CACHE_SIZE; i++) {
+        git2r_repository_cache_entry *entry = &git2r_repository_cache[i];
+
+        if (entry->repository && !strcmp(entry->path, CHAR(STRING_ELT(path, 0))))
+            git2r_repository_cache_entry_clear(entry);
+    }
+
+    return R_NilValue;
+}
+
 /**
  * Data structure to hold information when iterating over FETCH_HEAD
  * entries.
@@ -182,7 +403,7 @@ git2r_repository_fetch_heads(
         &cb_data);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -248,7 +469,7 @@ git2r_repository_head(
 cleanup:
     git_commit_free(commit);
     git_reference_free(reference);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -322,7 +543,7 @@ git2r_repository_is_bare(
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
     is_bare = git_repository_is_bare(repository);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (is_bare < 0)
         git2r_error(__func__, git_error_last(), NULL, NULL);
     return Rf_ScalarLogical(is_bare);
@@ -346,7 +567,7 @@ git2r_repository_is_shallow(
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
     is_shallow = git_repository_is_shallow(repository);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (is_shallow < 0)
         git2r_error(__func__, git_error_last(), NULL, NULL);
     return Rf_ScalarLogical(is_shallow);
@@ -370,7 +591,7 @@ git2r_repository_head_detached(
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
     head_detached = git_repository_head_detached(repository);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (head_detached < 0)
         git2r_error(__func__, git_error_last(), NULL, NULL);
     return Rf_ScalarLogical(head_detached);
@@ -394,7 +615,7 @@ git2r_repository_is_empty(
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
     is_empty = git_repository_is_empty(repository);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (is_empty < 0)
         git2r_error(__func__, git_error_last(), NULL, NULL);
     return Rf_ScalarLogical(is_empty);
@@ -450,7 +671,7 @@ git2r_repository_set_head(
 
     error = git_repository_set_head(repository, CHAR(STRING_ELT(ref_name, 0)));
 
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -496,7 +717,7 @@ git2r_repository_set_head_detached(
 
 cleanup:
     git_commit_free(treeish);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -530,7 +751,7 @@ git2r_repository_workdir(
         SET_STRING_ELT(result, 0, Rf_mkChar(wd));
     }
 
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
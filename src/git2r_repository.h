@@ -25,7 +25,10 @@
 #include <git2.h>
 
 git_repository* git2r_repository_open(SEXP repo);
+void git2r_repository_free(git_repository *repository);
+void git2r_repository_cache_clear(void);
 SEXP git2r_repository_can_open(SEXP path);
+SEXP git2r_repository_close(SEXP repo);
 SEXP git2r_repository_discover(SEXP path, SEXP ceiling);
 SEXP git2r_repository_fetch_heads(SEXP repo);
 SEXP git2r_repository_head(SEXP repo);
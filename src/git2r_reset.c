@@ -70,7 +70,7 @@ git2r_reset(
 
 cleanup:
     git_commit_free(target);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -121,7 +121,7 @@ cleanup:
     git_reference_free(head);
     git_object_free(head_commit);
     free(pathspec.strings);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
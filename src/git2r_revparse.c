@@ -97,7 +97,7 @@ git2r_revparse_single(
 
 cleanup:
     git_object_free(treeish);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -18,201 +18,3106 @@
 
 #include <R_ext/Visibility.h>
 #include <git2.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "git2r_arg.h"
+#include "git2r_bloom.h"
 #include "git2r_commit.h"
 #include "git2r_error.h"
-#include "git2r_oid.h"
+#include "git2r_oidmap.h"
 #include "git2r_repository.h"
 #include "git2r_S3.h"
+#include "git2r_thread.h"
 
 /**
- * Count number of revisions.
+ * Buffer with commit ids that grows by doubling.
+ */
+typedef struct {
+    git_oid *oids;
+    size_t n;
+    size_t capacity;
+} git2r_oid_buf;
+
+/**
+ * Append a commit id to the buffer.
  *
- * @param walker The walker to pop the commit from.
- * @param max_n n The upper limit of the number of commits to
- * output. Use max_n < 0 for unlimited number of commits.
- * @return The number of revisions
+ * @param buf The buffer to append to.
+ * @param oid The commit id to append.
+ * @return 0 on success, or an error code.
  */
 static int
-git2r_revwalk_count(
-    git_revwalk *walker,
-    int max_n)
+git2r_oid_buf_push(
+    git2r_oid_buf *buf,
+    const git_oid *oid)
 {
-    int n = 0;
-    git_oid oid;
+    if (buf->n == buf->capacity) {
+        size_t capacity = buf->capacity ? 2 * buf->capacity : 64;
+        git_oid *oids = realloc(buf->oids, capacity * sizeof(git_oid));
 
-    while (!git_revwalk_next(&oid, walker)) {
-        if (max_n < 0 || n < max_n)
-            n++;
-        else
+        if (!oids) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
+
+        buf->oids = oids;
+        buf->capacity = capacity;
+    }
+
+    git_oid_cpy(&(buf->oids[buf->n]), oid);
+    buf->n++;
+
+    return GIT_OK;
+}
+
+/**
+ * Data for each commit in the history of a shallow repository.
+ */
+typedef struct {
+    git_time_t time;
+    size_t parents;
+    size_t n_parents;
+} git2r_shallow_node;
+
+/**
+ * Commit and index into the nodes, used to sort the history of a
+ * shallow repository by commit time.
+ */
+typedef struct {
+    git_time_t time;
+    size_t index;
+} git2r_shallow_sort_item;
+
+/**
+ * Grow an array by doubling, if needed, to hold one more item.
+ *
+ * @param ptr The array to grow.
+ * @param capacity The capacity of the array.
+ * @param n The number of items in the array.
+ * @param size The size of an item.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_array_grow(
+    void **ptr,
+    size_t *capacity,
+    size_t n,
+    size_t size)
+{
+    if (n == *capacity) {
+        size_t new_capacity = *capacity ? 2 * *capacity : 64;
+        void *new_ptr = realloc(*ptr, new_capacity * size);
+
+        if (!new_ptr) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
+
+        *ptr = new_ptr;
+        *capacity = new_capacity;
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Read the ids of the commits at the boundary of a shallow
+ * repository from the 'shallow' file.
+ *
+ * @param out The map to add the ids to.
+ * @param repository The repository.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_shallow_read(
+    git2r_oidmap *out,
+    git_repository *repository)
+{
+    int error = GIT_OK;
+    const char *commondir = git_repository_commondir(repository);
+    char *path = NULL;
+    char line[128];
+    FILE *file = NULL;
+
+    path = malloc(strlen(commondir) + sizeof("shallow"));
+    if (!path) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+    strcpy(path, commondir);
+    strcat(path, "shallow");
+
+    file = fopen(path, "r");
+    if (!file)
+        goto cleanup;
+
+    while (fgets(line, sizeof(line), file)) {
+        git_oid oid;
+
+        if (strlen(line) < GIT_OID_HEXSZ ||
+            git_oid_fromstrn(&oid, line, GIT_OID_HEXSZ))
+            continue;
+
+        error = git2r_oidmap_put(out, &oid, 0);
+        if (error)
             break;
     }
 
-    return n;
+cleanup:
+    if (file)
+        fclose(file);
+    free(path);
+
+    return error;
 }
 
-/* Helper to find how many files in a commit changed from its nth
- * parent. */
 static int
-git2r_match_with_parent(
-    int *out,
-    git_commit *commit,
-    unsigned int i,
-    git_diff_options *opts)
+git2r_shallow_sort_item_cmp(
+    const void *a,
+    const void *b)
+{
+    const git2r_shallow_sort_item *x = a;
+    const git2r_shallow_sort_item *y = b;
+
+    if (x->time != y->time)
+        return x->time < y->time ? 1 : -1;
+    if (x->index != y->index)
+        return x->index < y->index ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Push a rank to a binary min-heap.
+ */
+static void
+git2r_heap_push(
+    size_t *heap,
+    size_t *n,
+    size_t rank)
+{
+    size_t i = (*n)++;
+
+    while (i > 0 && heap[(i - 1) / 2] > rank) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = rank;
+}
+
+/**
+ * Pop the smallest rank from a binary min-heap.
+ */
+static size_t
+git2r_heap_pop(
+    size_t *heap,
+    size_t *n)
+{
+    size_t top = heap[0], last = heap[--(*n)], i = 0;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+
+        if (child >= *n)
+            break;
+        if (child + 1 < *n && heap[child + 1] < heap[child])
+            child++;
+        if (heap[child] >= last)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*n)
+        heap[i] = last;
+
+    return top;
+}
+
+/**
+ * The commits reachable from a set of tips in a shallow repository,
+ * with the parents of each commit as indices into 'walked'.
+ */
+typedef struct {
+    git2r_oid_buf walked;
+    git2r_oidmap seen;
+    git2r_shallow_node *nodes;
+    size_t nodes_capacity;
+    size_t *edges;
+    size_t n_edges;
+    size_t edges_capacity;
+} git2r_shallow_graph;
+
+/**
+ * Add a commit to the graph, unless it is already in the graph or
+ * in the hidden set.
+ *
+ * @param out The index of the commit in the graph.
+ * @param added Set to 1 if the commit is in the graph, else 0.
+ * @param graph The graph.
+ * @param hidden The set of hidden commits, or NULL.
+ * @param oid The id of the commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_shallow_graph_add(
+    size_t *out,
+    int *added,
+    git2r_shallow_graph *graph,
+    const git2r_oidmap *hidden,
+    const git_oid *oid)
 {
     int error;
-    git_commit *parent = NULL;
-    git_tree *a = NULL, *b = NULL;
-    git_diff *diff = NULL;
+    size_t i;
+
+    *added = 1;
+    if (git2r_oidmap_get(out, &(graph->seen), oid))
+        return GIT_OK;
+
+    if (hidden && git2r_oidmap_get(&i, hidden, oid)) {
+        *added = 0;
+        return GIT_OK;
+    }
+
+    *out = graph->walked.n;
+    error = git2r_oid_buf_push(&(graph->walked), oid);
+    if (error)
+        return error;
+
+    return git2r_oidmap_put(&(graph->seen), oid, *out);
+}
+
+/**
+ * Collect the commits reachable from the tips in a shallow
+ * repository.
+ *
+ * The parents of the commits listed in the 'shallow' file are not
+ * followed, and parents that are missing from the object database
+ * are treated as the boundary as well. The commits are visited
+ * breadth-first in the same order as they are added, so the
+ * parents of each commit are contiguous in 'edges'.
+ *
+ * @param graph The graph to add the commits to.
+ * @param repository The repository.
+ * @param odb The object database of the repository.
+ * @param boundary The set of commits in the 'shallow' file.
+ * @param tips The ids of the commits to start from.
+ * @param hidden The set of commits to exclude, or NULL.
+ * @param first_parent Follow only the first parent of each commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_shallow_graph_walk(
+    git2r_shallow_graph *graph,
+    git_repository *repository,
+    git_odb *odb,
+    const git2r_oidmap *boundary,
+    const git2r_oid_buf *tips,
+    const git2r_oidmap *hidden,
+    int first_parent)
+{
+    int error = GIT_OK, added;
+    size_t i, j;
+
+    for (i = 0; i < tips->n; i++) {
+        error = git2r_shallow_graph_add(&j, &added, graph, hidden,
+                                        &(tips->oids[i]));
+        if (error)
+            return error;
+    }
+
+    for (i = 0; i < graph->walked.n; i++) {
+        git_commit *commit;
+        git_oid oid;
+        unsigned int k, n_parents;
+
+        error = git2r_array_grow((void **)&(graph->nodes),
+                                 &(graph->nodes_capacity),
+                                 i, sizeof(git2r_shallow_node));
+        if (error)
+            return error;
+
+        git_oid_cpy(&oid, &(graph->walked.oids[i]));
+        error = git_commit_lookup(&commit, repository, &oid);
+        if (error)
+            return error;
+
+        graph->nodes[i].time = git_commit_time(commit);
+        graph->nodes[i].parents = graph->n_edges;
+        graph->nodes[i].n_parents = 0;
+
+        n_parents = git2r_oidmap_get(&j, boundary, &oid) ?
+            0 : git_commit_parentcount(commit);
+        if (first_parent && n_parents > 1)
+            n_parents = 1;
+        for (k = 0; k < n_parents; k++) {
+            const git_oid *parent = git_commit_parent_id(commit, k);
+
+            if (!git2r_oidmap_get(&j, &(graph->seen), parent) &&
+                !git_odb_exists(odb, parent))
+                continue;
+
+            error = git2r_shallow_graph_add(&j, &added, graph, hidden,
+                                            parent);
+            if (error || !added)
+                continue;
+
+            error = git2r_array_grow((void **)&(graph->edges),
+                                     &(graph->edges_capacity),
+                                     graph->n_edges, sizeof(size_t));
+            if (error)
+                break;
+
+            graph->edges[graph->n_edges++] = j;
+            graph->nodes[i].n_parents++;
+        }
+
+        git_commit_free(commit);
+        if (error)
+            return error;
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Free the resources of the graph.
+ */
+static void
+git2r_shallow_graph_free(
+    git2r_shallow_graph *graph)
+{
+    free(graph->walked.oids);
+    git2r_oidmap_free(&(graph->seen));
+    free(graph->nodes);
+    free(graph->edges);
+}
+
+/**
+ * Collect and sort the history of a shallow repository.
+ *
+ * The commits are sorted by commit time, newest first. With
+ * GIT_SORT_TOPOLOGICAL, no parent is output before all of its
+ * children, and ties are broken by commit time.
+ *
+ * @param out The buffer to collect the ids in, in walk order.
+ * @param repository The repository.
+ * @param push The ids of the commits to start from.
+ * @param hide The ids of the commits to hide, together with their
+ * ancestors.
+ * @param sort_mode The GIT_SORT_* flags.
+ * @param first_parent Follow only the first parent of each commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_shallow(
+    git2r_oid_buf *out,
+    git_repository *repository,
+    const git2r_oid_buf *push,
+    const git2r_oid_buf *hide,
+    unsigned int sort_mode,
+    int first_parent)
+{
+    int error;
+    size_t i, j, n, n_heap = 0;
+    size_t *children = NULL, *rank = NULL, *heap = NULL;
+    git2r_shallow_graph graph, hidden;
+    git2r_oidmap boundary = {NULL, NULL, 0, 0};
+    git2r_shallow_sort_item *items = NULL;
+    git_odb *odb = NULL;
 
-    if ((error = git_commit_parent(&parent, commit, i)) < 0)
+    memset(&graph, 0, sizeof(git2r_shallow_graph));
+    memset(&hidden, 0, sizeof(git2r_shallow_graph));
+
+    error = git2r_shallow_read(&boundary, repository);
+    if (error)
+        goto cleanup;
+
+    error = git_repository_odb(&odb, repository);
+    if (error)
+        goto cleanup;
+
+    error = git2r_shallow_graph_walk(&hidden, repository, odb, &boundary,
+                                     hide, NULL, first_parent);
+    if (error)
         goto cleanup;
-    if ((error = git_commit_tree(&a, parent)) < 0)
+
+    error = git2r_shallow_graph_walk(&graph, repository, odb, &boundary,
+                                     push, &(hidden.seen), first_parent);
+    if (error)
         goto cleanup;
-    if ((error = git_commit_tree(&b, commit)) < 0)
+    n = graph.walked.n;
+    if (!n)
         goto cleanup;
-    if ((error = git_diff_tree_to_tree(&diff, git_commit_owner(commit), a, b, opts)) < 0)
+
+    /* Order the commits by time, newest first. */
+    items = malloc(n * sizeof(git2r_shallow_sort_item));
+    out->oids = malloc(n * sizeof(git_oid));
+    if (!items || !out->oids) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
         goto cleanup;
+    }
+    out->capacity = n;
+
+    for (i = 0; i < n; i++) {
+        items[i].time = graph.nodes[i].time;
+        items[i].index = i;
+    }
+    qsort(items, n, sizeof(git2r_shallow_sort_item),
+          git2r_shallow_sort_item_cmp);
+
+    if (sort_mode & GIT_SORT_TOPOLOGICAL) {
+        /* Kahn's algorithm, where a commit is ready when all of its
+         * children have been output. The ready commit with the
+         * lowest rank, i.e. the newest, is output first. */
+        children = calloc(n, sizeof(size_t));
+        rank = malloc(n * sizeof(size_t));
+        heap = malloc(n * sizeof(size_t));
+        if (!children || !rank || !heap) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            error = GIT_ERROR;
+            goto cleanup;
+        }
+
+        for (i = 0; i < n; i++)
+            rank[items[i].index] = i;
+        for (i = 0; i < graph.n_edges; i++)
+            children[graph.edges[i]]++;
+        for (i = 0; i < n; i++) {
+            if (!children[i])
+                git2r_heap_push(heap, &n_heap, rank[i]);
+        }
+
+        while (n_heap) {
+            size_t node = items[git2r_heap_pop(heap, &n_heap)].index;
+
+            git_oid_cpy(&(out->oids[out->n++]), &(graph.walked.oids[node]));
+            for (j = 0; j < graph.nodes[node].n_parents; j++) {
+                size_t parent = graph.edges[graph.nodes[node].parents + j];
+
+                if (!--children[parent])
+                    git2r_heap_push(heap, &n_heap, rank[parent]);
+            }
+        }
+    } else {
+        for (i = 0; i < n; i++) {
+            git_oid_cpy(&(out->oids[out->n++]),
+                        &(graph.walked.oids[items[i].index]));
+        }
+    }
 
-    *out = (git_diff_num_deltas(diff) > 0);
+    if (sort_mode & GIT_SORT_REVERSE) {
+        for (i = 0, j = out->n; i + 1 < j; i++, j--) {
+            git_oid tmp;
+
+            git_oid_cpy(&tmp, &(out->oids[i]));
+            git_oid_cpy(&(out->oids[i]), &(out->oids[j - 1]));
+            git_oid_cpy(&(out->oids[j - 1]), &tmp);
+        }
+    }
 
 cleanup:
-    git_diff_free(diff);
-    git_tree_free(a);
-    git_tree_free(b);
-    git_commit_free(parent);
+    git2r_shallow_graph_free(&graph);
+    git2r_shallow_graph_free(&hidden);
+    git2r_oidmap_free(&boundary);
+    free(items);
+    free(children);
+    free(rank);
+    free(heap);
+    git_odb_free(odb);
 
     return error;
 }
 
 /**
- * List revisions
+ * Resolve a revision to the id of a commit.
  *
- * @param repo S3 class git_repository
- * @param sha id of the commit to start from.
- * @param topological Sort the commits by topological order; Can be
- * combined with time.
- * @param time Sort the commits by commit time; can be combined with
- * topological.
- * @param reverse Sort the commits in reverse order
- * @param max_n n The upper limit of the number of commits to
- * output. Use max_n < 0 for unlimited number of commits.
- * @return list with S3 class git_commit objects
+ * @param out The id of the commit.
+ * @param repository The repository.
+ * @param spec The revision, or the empty string for HEAD.
+ * @return 0 on success, or an error code.
  */
-SEXP attribute_hidden
-git2r_revwalk_list(
-    SEXP repo,
-    SEXP sha,
-    SEXP topological,
-    SEXP time,
-    SEXP reverse,
-    SEXP max_n)
+static int
+git2r_revwalk_resolve(
+    git_oid *out,
+    git_repository *repository,
+    const char *spec)
 {
-    int error = GIT_OK, nprotect = 0;
-    SEXP result = R_NilValue;
-    int i, n;
-    unsigned int sort_mode = GIT_SORT_NONE;
-    git_revwalk *walker = NULL;
-    git_repository *repository = NULL;
+    int error;
+    git_object *obj = NULL, *commit = NULL;
+
+    error = git_revparse_single(&obj, repository, *spec ? spec : "HEAD");
+    if (!error)
+        error = git_object_peel(&commit, obj, GIT_OBJECT_COMMIT);
+    if (!error)
+        git_oid_cpy(out, git_object_id(commit));
+
+    git_object_free(commit);
+    git_object_free(obj);
+
+    return error;
+}
+
+typedef struct {
+    git_repository *repository;
+    git2r_oid_buf *buf;
+} git2r_revwalk_glob_payload;
+
+/**
+ * Callback for each reference that matches a glob. References that
+ * do not point to a commit are skipped, as in 'git log --glob'.
+ */
+static int
+git2r_revwalk_glob_cb(
+    const char *name,
+    void *payload)
+{
+    int error;
+    git_oid oid;
+    git2r_revwalk_glob_payload *p = payload;
+
+    error = git2r_revwalk_resolve(&oid, p->repository, name);
+    if (error) {
+        git_error_clear();
+        return GIT_OK;
+    }
+
+    return git2r_oid_buf_push(p->buf, &oid);
+}
+
+/**
+ * Resolve a revision to the commits to push to, and hide from, a
+ * revision walk.
+ *
+ * @param push The buffer to add the commits to walk from to.
+ * @param hide The buffer to add the commits to hide to.
+ * @param repository The repository.
+ * @param spec One of: a revision, e.g. a branch, a tag or a sha;
+ * '^rev' to hide the commits reachable from 'rev'; 'a..b' for the
+ * commits reachable from 'b' but not from 'a'; 'a...b' for the
+ * commits reachable from either 'a' or 'b' but not from both; or a
+ * reference glob, e.g. 'refs/tags/v*', for all matching
+ * references. An omitted side of a range is HEAD.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_spec(
+    git2r_oid_buf *push,
+    git2r_oid_buf *hide,
+    git_repository *repository,
+    const char *spec)
+{
+    int error;
+    const char *dots;
     git_oid oid;
 
-    if (git2r_arg_check_sha(sha))
-        git2r_error(__func__, NULL, "'sha'", git2r_err_sha_arg);
-    if (git2r_arg_check_logical(topological))
-        git2r_error(__func__, NULL, "'topological'", git2r_err_logical_arg);
-    if (git2r_arg_check_logical(time))
-        git2r_error(__func__, NULL, "'time'", git2r_err_logical_arg);
-    if (git2r_arg_check_logical(reverse))
-        git2r_error(__func__, NULL, "'reverse'", git2r_err_logical_arg);
-    if (git2r_arg_check_integer(max_n))
-        git2r_error(__func__, NULL, "'max_n'", git2r_err_integer_arg);
+    if (*spec == '^') {
+        push = hide;
+        spec++;
+    }
+
+    dots = strstr(spec, "..");
+    if (dots) {
+        int symmetric = dots[2] == '.';
+        size_t len = (size_t)(dots - spec);
+        char *lhs;
+        git_oid rhs;
+
+        lhs = malloc(len + 1);
+        if (!lhs) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
+        memcpy(lhs, spec, len);
+        lhs[len] = '\0';
+
+        error = git2r_revwalk_resolve(&oid, repository, lhs);
+        free(lhs);
+        if (error)
+            return error;
+
+        error = git2r_revwalk_resolve(&rhs, repository,
+                                      dots + (symmetric ? 3 : 2));
+        if (error)
+            return error;
+
+        error = git2r_oid_buf_push(push, &rhs);
+        if (error)
+            return error;
+
+        if (symmetric) {
+            git_oidarray bases = {NULL, 0};
+            size_t i;
+
+            error = git2r_oid_buf_push(push, &oid);
+            if (error)
+                return error;
+
+            /* Hide all merge bases, since there may be more than
+             * one after criss-cross merges. */
+            error = git_merge_bases(&bases, repository, &oid, &rhs);
+            if (error == GIT_ENOTFOUND) {
+                git_error_clear();
+                return GIT_OK;
+            }
+
+            for (i = 0; !error && i < bases.count; i++)
+                error = git2r_oid_buf_push(hide, &(bases.ids[i]));
+            git_oidarray_free(&bases);
+
+            return error;
+        }
+
+        return git2r_oid_buf_push(hide, &oid);
+    }
+
+    if (strpbrk(spec, "*?[")) {
+        git2r_revwalk_glob_payload payload = {repository, push};
+        char *glob = NULL;
+        int prefix = strncmp(spec, "refs/", 5) != 0;
+
+        /* Prepend 'refs/' as in 'git log --glob'. */
+        glob = malloc(strlen(spec) + (prefix ? 6 : 1));
+        if (!glob) {
+            giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+            return GIT_ERROR;
+        }
+        strcpy(glob, prefix ? "refs/" : "");
+        strcat(glob, spec);
+
+        error = git_reference_foreach_glob(repository, glob,
+                                           git2r_revwalk_glob_cb,
+                                           &payload);
+        free(glob);
+
+        return error;
+    }
+
+    error = git2r_revwalk_resolve(&oid, repository, spec);
+    if (error)
+        return error;
+
+    return git2r_oid_buf_push(push, &oid);
+}
+
+/**
+ * Resolve the revisions to walk and to hide to commit ids.
+ *
+ * @param push The buffer to append the ids of the commits to walk
+ * from.
+ * @param hide_oids The buffer to append the ids of the commits to
+ * hide.
+ * @param repository The repository.
+ * @param ref Character vector with the revisions to walk, see
+ * git2r_revwalk_spec, or R_NilValue to walk from HEAD.
+ * @param hide Character vector with the revisions to hide, or
+ * R_NilValue.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_tips_resolve(
+    git2r_oid_buf *push,
+    git2r_oid_buf *hide_oids,
+    git_repository *repository,
+    SEXP ref,
+    SEXP hide)
+{
+    int error = GIT_OK;
+    size_t i;
+
+    if (Rf_isNull(ref)) {
+        error = git2r_revwalk_spec(push, hide_oids, repository, "HEAD");
+    } else {
+        for (i = 0; !error && i < (size_t)Rf_xlength(ref); i++) {
+            error = git2r_revwalk_spec(push, hide_oids, repository,
+                                       CHAR(STRING_ELT(ref, i)));
+        }
+    }
+    if (!Rf_isNull(hide)) {
+        /* A range in 'hide' hides both of its sides. */
+        for (i = 0; !error && i < (size_t)Rf_xlength(hide); i++) {
+            error = git2r_revwalk_spec(hide_oids, hide_oids, repository,
+                                       CHAR(STRING_ELT(hide, i)));
+        }
+    }
+
+    return error;
+}
+
+/**
+ * Iterator over the revisions in a history.
+ *
+ * The revisions are walked by libgit2, except in a shallow
+ * repository, where the history is collected and sorted up front by
+ * git2r_revwalk_shallow and then popped from 'shallow'. When the
+ * commit messages are matched with a regular expression, the
+ * candidates are matched in batches by 'grep_fun' and the matching
+ * ids are popped from 'matched'.
+ */
+typedef struct {
+    git_revwalk *walker;
+    git2r_oid_buf shallow;
+    size_t pos;
+    git_repository *repository;
+    int first_parent;
+    int filter;
+    int has_since;
+    int has_until;
+    int stop_at_since;
+    int since_slop;
+    git_time_t since;
+    git_time_t until;
+    const char *author;
+    const char *committer;
+    const char *grep;
+    size_t grep_len;
+    int grep_field;
+    SEXP grep_fun;
+    char *grep_text;
+    size_t grep_text_capacity;
+    git2r_oid_buf matched;
+    size_t matched_pos;
+    size_t grep_batch;
+    int max_n;
+    size_t n;
+    int done;
+} git2r_revwalk_iter;
+
+/**
+ * The part of the commit message to search with 'grep'.
+ */
+enum {
+    git2r_revwalk_grep__message,
+    git2r_revwalk_grep__summary,
+    git2r_revwalk_grep__body,
+    git2r_revwalk_grep__trailers};
+
+static const char *git2r_revwalk_grep_fields[] = {
+    "message", "summary", "body", "trailers", NULL};
+
+/**
+ * Number of commit messages to match with a regular expression in
+ * one call to R.
+ */
+#define GIT2R_REVWALK_GREP_BATCH 1024
+
+/**
+ * Number of consecutive commits older than 'since' to walk before
+ * the walk stops, as the SLOP of 'git log --since'.
+ */
+#define GIT2R_REVWALK_SINCE_SLOP 5
+
+/**
+ * Check the filter of a revision walk.
+ *
+ * @param filter The filter to check.
+ * @return 0 if OK, else -1
+ */
+static int
+git2r_revwalk_check_filter(
+    SEXP filter)
+{
+    SEXP item;
+
+    if (Rf_isNull(filter))
+        return 0;
+    if (git2r_arg_check_list(filter))
+        return -1;
+
+    if (git2r_arg_check_logical(git2r_get_list_element(filter, "first_parent")))
+        return -1;
+
+    item = git2r_get_list_element(filter, "since");
+    if (!Rf_isNull(item) && (!Rf_isReal(item) || Rf_length(item) != 1 ||
+                             ISNAN(REAL(item)[0])))
+        return -1;
+    item = git2r_get_list_element(filter, "until");
+    if (!Rf_isNull(item) && (!Rf_isReal(item) || Rf_length(item) != 1 ||
+                             ISNAN(REAL(item)[0])))
+        return -1;
+
+    item = git2r_get_list_element(filter, "author");
+    if (!Rf_isNull(item) && git2r_arg_check_string(item))
+        return -1;
+    item = git2r_get_list_element(filter, "committer");
+    if (!Rf_isNull(item) && git2r_arg_check_string(item))
+        return -1;
+
+    item = git2r_get_list_element(filter, "grep");
+    if (!Rf_isNull(item)) {
+        size_t i;
+        const char *field;
+
+        if (git2r_arg_check_string(item))
+            return -1;
+
+        item = git2r_get_list_element(filter, "grep_field");
+        if (git2r_arg_check_string(item))
+            return -1;
+        field = CHAR(STRING_ELT(item, 0));
+        for (i = 0; git2r_revwalk_grep_fields[i]; i++) {
+            if (!strcmp(field, git2r_revwalk_grep_fields[i]))
+                break;
+        }
+        if (!git2r_revwalk_grep_fields[i])
+            return -1;
+
+        item = git2r_get_list_element(filter, "grep_fun");
+        if (!Rf_isNull(item) && !Rf_isFunction(item))
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Get the trailers of a commit message as lines of 'key: value'.
+ *
+ * @param out The trailers. The string is owned by the iterator and
+ * valid until the next call.
+ * @param out_len The length of the trailers.
+ * @param iter The iterator.
+ * @param commit The commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_grep_trailers(
+    const char **out,
+    size_t *out_len,
+    git2r_revwalk_iter *iter,
+    git_commit *commit)
+{
+    int error;
+    size_t i, len = 0;
+    git_message_trailer_array trailers = {NULL, 0, NULL};
+
+    error = git_message_trailers(&trailers, git_commit_message(commit));
+    if (error)
+        return error;
+
+    for (i = 0; i < trailers.count; i++) {
+        const char *key = trailers.trailers[i].key;
+        const char *value = trailers.trailers[i].value;
+        size_t key_len = strlen(key), value_len = strlen(value);
+        size_t size = len + key_len + value_len + 4;
+
+        if (size > iter->grep_text_capacity) {
+            size_t capacity = iter->grep_text_capacity ?
+                iter->grep_text_capacity : 256;
+            char *text;
+
+            while (size > capacity)
+                capacity *= 2;
+            text = realloc(iter->grep_text, capacity);
+            if (!text) {
+                giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+                error = GIT_ERROR;
+                break;
+            }
+
+            iter->grep_text = text;
+            iter->grep_text_capacity = capacity;
+        }
+
+        memcpy(iter->grep_text + len, key, key_len);
+        len += key_len;
+        memcpy(iter->grep_text + len, ": ", 2);
+        len += 2;
+        memcpy(iter->grep_text + len, value, value_len);
+        len += value_len;
+        iter->grep_text[len++] = '\n';
+    }
+
+    if (!error) {
+        *out = len ? iter->grep_text : "";
+        *out_len = len;
+    }
+
+    git_message_trailer_array_free(&trailers);
+
+    return error;
+}
+
+/**
+ * Get the part of a commit message to search with 'grep'.
+ *
+ * @param out The text to search, which is valid until the commit is
+ * freed or the next call.
+ * @param out_len The length of the text.
+ * @param iter The iterator.
+ * @param commit The commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_grep_text(
+    const char **out,
+    size_t *out_len,
+    git2r_revwalk_iter *iter,
+    git_commit *commit)
+{
+    const char *text;
+
+    switch (iter->grep_field) {
+    case git2r_revwalk_grep__summary:
+        text = git_commit_summary(commit);
+        break;
+    case git2r_revwalk_grep__body:
+        text = git_commit_body(commit);
+        break;
+    case git2r_revwalk_grep__trailers:
+        return git2r_revwalk_grep_trailers(out, out_len, iter, commit);
+    default:
+        text = git_commit_message(commit);
+        break;
+    }
+
+    *out = text ? text : "";
+    *out_len = strlen(*out);
+
+    return GIT_OK;
+}
+
+/**
+ * The encoding to mark the message of a commit with in R. As in git,
+ * a message without an encoding header is UTF-8, and a message in
+ * another encoding is passed as bytes.
+ *
+ * @param commit The commit.
+ * @return The encoding of the message.
+ */
+static cetype_t
+git2r_revwalk_message_cetype(
+    const git_commit *commit)
+{
+    const char *encoding = git_commit_message_encoding(commit);
+
+    if (!encoding ||
+        !strcmp(encoding, "UTF-8") || !strcmp(encoding, "utf-8") ||
+        !strcmp(encoding, "UTF8") || !strcmp(encoding, "utf8"))
+        return CE_UTF8;
+
+    return CE_BYTES;
+}
+
+/**
+ * Find a fixed string in a text.
+ *
+ * The text is scanned for the first byte of the pattern with memchr,
+ * which most C libraries vectorize, and the rest of the pattern is
+ * only compared at the candidates.
+ *
+ * @param text The text to search.
+ * @param len The length of the text.
+ * @param pattern The fixed string to find.
+ * @param pattern_len The length of the pattern.
+ * @return 1 if the pattern is found, else 0.
+ */
+static int
+git2r_revwalk_grep_fixed(
+    const char *text,
+    size_t len,
+    const char *pattern,
+    size_t pattern_len)
+{
+    size_t pos = 0;
+
+    if (!pattern_len)
+        return 1;
+    if (len < pattern_len)
+        return 0;
+
+    while (pos <= len - pattern_len) {
+        const char *p = memchr(text + pos, pattern[0],
+                               len - pattern_len - pos + 1);
+
+        if (!p)
+            return 0;
+        pos = (size_t)(p - text);
+        if (!memcmp(p + 1, pattern + 1, pattern_len - 1))
+            return 1;
+        pos++;
+    }
+
+    return 0;
+}
+
+/**
+ * Check if a signature matches a pattern.
+ *
+ * @param signature The signature.
+ * @param pattern The fixed string to find in the name or the email,
+ * or NULL to match any signature.
+ * @return 1 if the signature matches, else 0.
+ */
+static int
+git2r_revwalk_signature_match(
+    const git_signature *signature,
+    const char *pattern)
+{
+    if (!pattern)
+        return 1;
+
+    return (signature->name && strstr(signature->name, pattern)) ||
+        (signature->email && strstr(signature->email, pattern));
+}
+
+/**
+ * Apply the filter of the iterator to a commit.
+ *
+ * @param out 1 if the commit matches the filter, 0 if it does not
+ * match, and -1 if no later commit can match.
+ * @param iter The iterator.
+ * @param commit The commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_iter_match(
+    int *out,
+    git2r_revwalk_iter *iter,
+    git_commit *commit)
+{
+    int error = GIT_OK;
+    git_time_t when;
+
+    when = git_commit_time(commit);
+    if (iter->has_since && when < iter->since) {
+        /* As in git, keep walking past a few older commits before
+         * stopping, in case of clock skew between the commits. */
+        *out = 0;
+        if (iter->stop_at_since && ++(iter->since_slop) > GIT2R_REVWALK_SINCE_SLOP)
+            *out = -1;
+    } else if (iter->has_until && when > iter->until) {
+        iter->since_slop = 0;
+        *out = 0;
+    } else {
+        iter->since_slop = 0;
+        *out = git2r_revwalk_signature_match(
+            git_commit_author(commit), iter->author) &&
+            git2r_revwalk_signature_match(
+                git_commit_committer(commit), iter->committer);
+    }
+
+    /* A regular expression is matched in batches by the caller. */
+    if (*out == 1 && iter->grep && !iter->grep_fun) {
+        const char *text;
+        size_t len;
+
+        error = git2r_revwalk_grep_text(&text, &len, iter, commit);
+        if (!error) {
+            *out = git2r_revwalk_grep_fixed(text, len, iter->grep,
+                                            iter->grep_len);
+        }
+    }
+
+    return error;
+}
+
+/**
+ * Start to iterate over the revisions in a history.
+ *
+ * @param iter The iterator to initialize. Free with
+ * git2r_revwalk_iter_free, also on error.
+ * @param repository The repository.
+ * @param ref Character vector with the revisions to walk, see
+ * git2r_revwalk_spec, or R_NilValue to walk from HEAD.
+ * @param hide Character vector with the revisions to hide, or
+ * R_NilValue.
+ * @param sort_mode The GIT_SORT_* flags.
+ * @param filter List with the items 'first_parent', 'since',
+ * 'until', 'author', 'committer', 'grep', 'grep_field' and
+ * 'grep_fun', or R_NilValue. The commit time must be within 'since'
+ * and 'until', in seconds since the epoch, and 'author' and
+ * 'committer' are fixed strings to find in the name or the email of
+ * the signature. 'grep' is the pattern to find in the part of the
+ * message in 'grep_field', as a fixed string if 'grep_fun' is NULL,
+ * else 'grep_fun' is an R function that takes a character vector
+ * with messages and returns a logical vector with the matches.
+ * Items that are NULL are not used. The strings must remain valid
+ * while iterating.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_iter_init(
+    git2r_revwalk_iter *iter,
+    git_repository *repository,
+    SEXP ref,
+    SEXP hide,
+    unsigned int sort_mode,
+    SEXP filter)
+{
+    int error = GIT_OK;
+    size_t i;
+    git2r_oid_buf push_oids = {NULL, 0, 0};
+    git2r_oid_buf hide_oids = {NULL, 0, 0};
+
+    memset(iter, 0, sizeof(git2r_revwalk_iter));
+    iter->repository = repository;
+    iter->max_n = -1;
+
+    if (!Rf_isNull(filter)) {
+        SEXP item;
+
+        iter->first_parent =
+            LOGICAL(git2r_get_list_element(filter, "first_parent"))[0];
+
+        item = git2r_get_list_element(filter, "since");
+        if (!Rf_isNull(item)) {
+            iter->has_since = 1;
+            iter->since = (git_time_t)REAL(item)[0];
+        }
+
+        item = git2r_get_list_element(filter, "until");
+        if (!Rf_isNull(item)) {
+            iter->has_until = 1;
+            iter->until = (git_time_t)REAL(item)[0];
+        }
+
+        item = git2r_get_list_element(filter, "author");
+        if (!Rf_isNull(item))
+            iter->author = CHAR(STRING_ELT(item, 0));
+
+        item = git2r_get_list_element(filter, "committer");
+        if (!Rf_isNull(item))
+            iter->committer = CHAR(STRING_ELT(item, 0));
+
+        item = git2r_get_list_element(filter, "grep");
+        if (!Rf_isNull(item)) {
+            const char *field;
+
+            iter->grep = CHAR(STRING_ELT(item, 0));
+            iter->grep_len = strlen(iter->grep);
+
+            field = CHAR(STRING_ELT(
+                git2r_get_list_element(filter, "grep_field"), 0));
+            for (i = 0; git2r_revwalk_grep_fields[i]; i++) {
+                if (!strcmp(field, git2r_revwalk_grep_fields[i]))
+                    iter->grep_field = (int)i;
+            }
+
+            item = git2r_get_list_element(filter, "grep_fun");
+            if (!Rf_isNull(item))
+                iter->grep_fun = item;
+        }
+
+        iter->filter = iter->has_since || iter->has_until ||
+            iter->author || iter->committer || iter->grep;
+
+        /* When the commits are output newest first by commit time,
+         * the walk can stop after a few consecutive commits older
+         * than 'since'. */
+        iter->stop_at_since = (sort_mode == GIT_SORT_TIME);
+    }
+
+    error = git2r_revwalk_tips_resolve(&push_oids, &hide_oids, repository,
+                                       ref, hide);
+    if (error)
+        goto cleanup;
+
+    if (git_repository_is_shallow(repository)) {
+        error = git2r_revwalk_shallow(&(iter->shallow), repository,
+                                      &push_oids, &hide_oids, sort_mode,
+                                      iter->first_parent);
+        goto cleanup;
+    }
+
+    error = git_revwalk_new(&(iter->walker), repository);
+    if (error)
+        goto cleanup;
+    git_revwalk_sorting(iter->walker, sort_mode);
+    if (iter->first_parent)
+        git_revwalk_simplify_first_parent(iter->walker);
+
+    for (i = 0; !error && i < push_oids.n; i++)
+        error = git_revwalk_push(iter->walker, &(push_oids.oids[i]));
+    for (i = 0; !error && i < hide_oids.n; i++)
+        error = git_revwalk_hide(iter->walker, &(hide_oids.oids[i]));
+
+cleanup:
+    free(push_oids.oids);
+    free(hide_oids.oids);
+
+    return error;
+}
+
+/**
+ * Get the next revision from the walk that matches the filter,
+ * except a regular expression in 'grep'.
+ *
+ * @param out The id of the next commit.
+ * @param commit If not NULL, the looked up commit, that must be
+ * freed by the caller. The commit is only looked up if it is
+ * requested or needed by the filter.
+ * @param iter The iterator.
+ * @return 0 on success, GIT_ITEROVER if there are no more
+ * revisions, or an error code.
+ */
+static int
+git2r_revwalk_iter_step(
+    git_oid *out,
+    git_commit **commit,
+    git2r_revwalk_iter *iter)
+{
+    for (;;) {
+        int error, match = 1;
+        git_commit *c;
+
+        if (iter->walker) {
+            error = git_revwalk_next(out, iter->walker);
+            if (error)
+                return error;
+        } else {
+            if (iter->pos == iter->shallow.n)
+                return GIT_ITEROVER;
+            git_oid_cpy(out, &(iter->shallow.oids[iter->pos++]));
+        }
+
+        if (!iter->filter && !commit)
+            return GIT_OK;
+
+        error = git_commit_lookup(&c, iter->repository, out);
+        if (error)
+            return error;
+        if (iter->filter)
+            error = git2r_revwalk_iter_match(&match, iter, c);
+        if (error || match < 1) {
+            git_commit_free(c);
+            if (error)
+                return error;
+            if (match < 0)
+                return GIT_ITEROVER;
+            continue;
+        }
+
+        if (commit)
+            *commit = c;
+        else
+            git_commit_free(c);
+
+        return GIT_OK;
+    }
+}
+
+/**
+ * Match the messages of the next batch of revisions with the regular
+ * expression of the iterator, and save the ids of the matching
+ * commits in 'matched'.
+ *
+ * The messages of the batch are copied to one character vector and
+ * matched in one call to 'grep_fun', so that R can match them in a
+ * vectorized way. No R object is created for the commits.
+ *
+ * @param iter The iterator.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_grep_batch(
+    git2r_revwalk_iter *iter)
+{
+    int error = GIT_OK, nprotect = 0, eval_error = 0;
+    size_t i, j, n = 0, size;
+    SEXP text, call, result;
+
+    iter->matched.n = 0;
+    iter->matched_pos = 0;
+
+    /* Read no more commits than are needed for the remaining number
+     * of commits, but double the batch while the matches are too few
+     * to reach it. */
+    size = GIT2R_REVWALK_GREP_BATCH;
+    if (iter->max_n >= 0) {
+        size = (size_t)iter->max_n - iter->n;
+        if (size < 2 * iter->grep_batch)
+            size = 2 * iter->grep_batch;
+        if (size > GIT2R_REVWALK_GREP_BATCH)
+            size = GIT2R_REVWALK_GREP_BATCH;
+        if (size < 1)
+            size = 1;
+    }
+    iter->grep_batch = size;
+
+    PROTECT(text = Rf_allocVector(STRSXP, size));
+    nprotect++;
+
+    while (n < size) {
+        git_oid oid;
+        git_commit *commit;
+        const char *str;
+        size_t len;
+
+        error = git2r_revwalk_iter_step(&oid, &commit, iter);
+        if (error == GIT_ITEROVER) {
+            iter->done = 1;
+            error = GIT_OK;
+            break;
+        }
+        if (error)
+            goto cleanup;
+
+        error = git2r_revwalk_grep_text(&str, &len, iter, commit);
+        if (!error) {
+            SET_STRING_ELT(text, n, Rf_mkCharLenCE(
+                               str, (int)len,
+                               git2r_revwalk_message_cetype(commit)));
+            error = git2r_oid_buf_push(&(iter->matched), &oid);
+        }
+
+        git_commit_free(commit);
+
+        if (error)
+            goto cleanup;
+        n++;
+    }
+
+    if (!n)
+        goto cleanup;
+    if (n < size) {
+        PROTECT(text = Rf_xlengthgets(text, (R_xlen_t)n));
+        nprotect++;
+    }
+
+    PROTECT(call = Rf_lang2(iter->grep_fun, text));
+    nprotect++;
+    result = R_tryEval(call, R_GlobalEnv, &eval_error);
+    if (eval_error || !Rf_isLogical(result) ||
+        (size_t)Rf_xlength(result) != n) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_revwalk_grep);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    for (i = 0, j = 0; i < n; i++) {
+        if (LOGICAL(result)[i] == TRUE)
+            git_oid_cpy(&(iter->matched.oids[j++]), &(iter->matched.oids[i]));
+    }
+    iter->matched.n = j;
+
+cleanup:
+    if (error)
+        iter->matched.n = 0;
+
+    UNPROTECT(nprotect);
+
+    return error;
+}
+
+/**
+ * Get the next revision from the iterator that matches the filter.
+ *
+ * @param out The id of the next commit.
+ * @param iter The iterator.
+ * @return 0 on success, GIT_ITEROVER if there are no more
+ * revisions, or an error code.
+ */
+static int
+git2r_revwalk_iter_next(
+    git_oid *out,
+    git2r_revwalk_iter *iter)
+{
+    if (!iter->grep_fun)
+        return git2r_revwalk_iter_step(out, NULL, iter);
+
+    while (iter->matched_pos == iter->matched.n) {
+        int error;
+
+        if (iter->done)
+            return GIT_ITEROVER;
+
+        error = git2r_revwalk_grep_batch(iter);
+        if (error)
+            return error;
+    }
+
+    git_oid_cpy(out, &(iter->matched.oids[iter->matched_pos++]));
+    iter->n++;
+
+    return GIT_OK;
+}
+
+/**
+ * Free the resources of the iterator.
+ */
+static void
+git2r_revwalk_iter_free(
+    git2r_revwalk_iter *iter)
+{
+    git_revwalk_free(iter->walker);
+    free(iter->shallow.oids);
+    free(iter->matched.oids);
+    free(iter->grep_text);
+}
+
+/**
+ * Walk the revisions and collect their ids.
+ *
+ * The ids are collected in a buffer that grows by doubling, so the
+ * history is walked exactly once.
+ *
+ * @param out The buffer to collect the ids in. The buffer must be
+ * freed by the caller with 'free(out->oids)'.
+ * @param iter The iterator to pop the commits from.
+ * @param max_n n The upper limit of the number of commits to
+ * output. Use max_n < 0 for unlimited number of commits.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_collect(
+    git2r_oid_buf *out,
+    git2r_revwalk_iter *iter,
+    int max_n)
+{
+    int error;
+    git_oid oid;
+
+    iter->max_n = max_n;
+    while (max_n < 0 || out->n < (size_t)max_n) {
+        error = git2r_revwalk_iter_next(&oid, iter);
+        if (error) {
+            if (GIT_ITEROVER == error)
+                break;
+            return error;
+        }
+
+        error = git2r_oid_buf_push(out, &oid);
+        if (error)
+            return error;
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Init a list with S3 class git_commit objects from commit ids.
+ *
+ * @param dest The list to initialize, with the same length as the
+ * number of ids in 'buf'.
+ * @param buf The ids of the commits.
+ * @param repository The repository.
+ * @param repo S3 class git_repository that contains the commits.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_commit_list(
+    SEXP dest,
+    const git2r_oid_buf *buf,
+    git_repository *repository,
+    SEXP repo)
+{
+    size_t i;
+
+    for (i = 0; i < buf->n; i++) {
+        int error;
+        git_commit *commit;
+        SEXP item;
+
+        error = git_commit_lookup(&commit, repository, &(buf->oids[i]));
+        if (error)
+            return error;
+
+        SET_VECTOR_ELT(
+            dest,
+            i,
+            item = Rf_mkNamed(VECSXP, git2r_S3_items__git_commit));
+        Rf_setAttrib(item, R_ClassSymbol,
+                     Rf_mkString(git2r_S3_class__git_commit));
+        git2r_commit_init(commit, repo, item);
+        git_commit_free(commit);
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Check if a path differs between two trees.
+ *
+ * The path is resolved one component at a time in both trees. As
+ * soon as the two subtrees on the path have the same id, the path
+ * cannot differ and the rest of the subtrees are never read.
+ *
+ * @param out 1 if the path differs between the trees, else 0.
+ * @param repository The repository with the trees.
+ * @param a Id of the first tree, or NULL for the empty tree.
+ * @param b Id of the second tree, or NULL for the empty tree.
+ * @param path The path to compare.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_tree_path_changed(
+    int *out,
+    git_repository *repository,
+    const git_oid *a,
+    const git_oid *b,
+    const char *path)
+{
+    int error = GIT_OK;
+    char *name = NULL;
+    git_oid oid_a, oid_b;
+    git_tree *tree_a = NULL, *tree_b = NULL;
+
+    *out = 0;
+
+    name = malloc(strlen(path) + 1);
+    if (!name) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        return GIT_ERROR;
+    }
+
+    for (;;) {
+        size_t len;
+        git_filemode_t mode;
+        const git_tree_entry *entry_a = NULL, *entry_b = NULL;
+
+        /* Same subtree, nothing on the path can differ. */
+        if (a && b && git_oid_equal(a, b))
+            break;
+
+        /* Skip separators, e.g. a trailing '/' for a directory. */
+        while (*path == '/')
+            path++;
+        if (!*path)
+            break;
+        len = strcspn(path, "/");
+        memcpy(name, path, len);
+        name[len] = '\0';
+        path += len;
+
+        if (a) {
+            if ((error = git_tree_lookup(&tree_a, repository, a)) < 0)
+                goto cleanup;
+            entry_a = git_tree_entry_byname(tree_a, name);
+        }
+
+        if (b) {
+            if ((error = git_tree_lookup(&tree_b, repository, b)) < 0)
+                goto cleanup;
+            entry_b = git_tree_entry_byname(tree_b, name);
+        }
+
+        if (!entry_a || !entry_b) {
+            *out = (entry_a != entry_b);
+            break;
+        }
+
+        if (git_tree_entry_filemode(entry_a) !=
+            git_tree_entry_filemode(entry_b)) {
+            *out = 1;
+            break;
+        }
+
+        mode = git_tree_entry_filemode(entry_a);
+        git_oid_cpy(&oid_a, git_tree_entry_id(entry_a));
+        git_oid_cpy(&oid_b, git_tree_entry_id(entry_b));
+        git_tree_free(tree_a);
+        tree_a = NULL;
+        git_tree_free(tree_b);
+        tree_b = NULL;
+
+        if (strspn(path, "/") == strlen(path)) {
+            /* Last component of the path. */
+            *out = !git_oid_equal(&oid_a, &oid_b);
+            break;
+        }
+
+        /* A path below a blob does not exist in either tree. */
+        if (mode != GIT_FILEMODE_TREE)
+            break;
+
+        a = &oid_a;
+        b = &oid_b;
+    }
+
+cleanup:
+    git_tree_free(tree_a);
+    git_tree_free(tree_b);
+    free(name);
+
+    return error;
+}
+
+/**
+ * Check whether a commit is a "touching" commit---that is, a commit
+ * that has modified the selected path.
+ *
+ * A merge commit is only a touching commit if the path differs from
+ * every parent, i.e. the merge is not TREESAME to any of its
+ * parents. The side branches of a TREESAME merge are not pruned
+ * from the walk, as 'git log -- path' does in its history
+ * simplification.
+ *
+ * @param out 1 if the commit modified the path, else 0.
+ * @param commit The commit to check.
+ * @param path The path to check.
+ * @param first_parent Compare only with the first parent, as with
+ * 'git log --first-parent -- path'.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_match_path(
+    int *out,
+    git_commit *commit,
+    const char *path,
+    int first_parent)
+{
+    int error;
+    unsigned int i, parents;
+    git_repository *repository = git_commit_owner(commit);
+    const git_oid *tree_id = git_commit_tree_id(commit);
+
+    parents = git_commit_parentcount(commit);
+    if (parents == 0)
+        return git2r_tree_path_changed(out, repository, NULL, tree_id, path);
+    if (first_parent)
+        parents = 1;
+
+    for (i = 0; i < parents; i++) {
+        git_commit *parent;
+
+        if ((error = git_commit_parent(&parent, commit, i)) < 0)
+            return error;
+        error = git2r_tree_path_changed(
+            out, repository, git_commit_tree_id(parent), tree_id, path);
+        git_commit_free(parent);
+        if (error < 0)
+            return error;
+        if (!*out)
+            break;
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Follow a path across a rename.
+ *
+ * If the path was created in the commit by renaming a file in the
+ * first parent, the path is replaced with the name of the file in
+ * the parent, as with 'git log --follow -- path'.
+ *
+ * @param path The path to follow. Replaced with a newly allocated
+ * string if the file was renamed. The string must be freed by the
+ * caller.
+ * @param commit The commit that modified the path.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_follow_path(
+    char **path,
+    git_commit *commit)
+{
+    int error;
+    size_t i, n;
+    git_commit *parent = NULL;
+    git_tree *old_tree = NULL, *new_tree = NULL;
+    git_tree_entry *entry = NULL;
+    git_diff *diff = NULL;
+    git_diff_find_options findopts = GIT_DIFF_FIND_OPTIONS_INIT;
+
+    /* Only a single parent history is followed. */
+    if (git_commit_parentcount(commit) != 1)
+        return GIT_OK;
+
+    if ((error = git_commit_parent(&parent, commit, 0)) < 0)
+        goto cleanup;
+    if ((error = git_commit_tree(&old_tree, parent)) < 0)
+        goto cleanup;
+
+    /* Check if the path was created in the commit. */
+    error = git_tree_entry_bypath(&entry, old_tree, *path);
+    if (error != GIT_ENOTFOUND)
+        goto cleanup;
+
+    if ((error = git_commit_tree(&new_tree, commit)) < 0)
+        goto cleanup;
+    error = git_diff_tree_to_tree(
+        &diff, git_commit_owner(commit), old_tree, new_tree, NULL);
+    if (error)
+        goto cleanup;
+    findopts.flags = GIT_DIFF_FIND_RENAMES;
+    if ((error = git_diff_find_similar(diff, &findopts)) < 0)
+        goto cleanup;
+
+    n = git_diff_num_deltas(diff);
+    for (i = 0; i < n; i++) {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+
+        if (delta->status == GIT_DELTA_RENAMED &&
+            strcmp(delta->new_file.path, *path) == 0) {
+            char *old_path = strdup(delta->old_file.path);
+
+            if (!old_path) {
+                giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+                error = GIT_ERROR;
+                goto cleanup;
+            }
+
+            free(*path);
+            *path = old_path;
+            break;
+        }
+    }
+
+cleanup:
+    if (error == GIT_ENOTFOUND)
+        error = GIT_OK;
+    git_diff_free(diff);
+    git_tree_entry_free(entry);
+    git_tree_free(old_tree);
+    git_tree_free(new_tree);
+    git_commit_free(parent);
+
+    return error;
+}
+
+/**
+ * List revisions
+ *
+ * @param repo S3 class git_repository
+ * @param ref Character vector with the revisions to walk, see
+ * git2r_revwalk_spec, or R_NilValue to walk from HEAD.
+ * @param hide Character vector with the revisions to hide, or
+ * R_NilValue.
+ * @param filter List with the filter of the commits, see
+ * git2r_revwalk_iter_init, or R_NilValue.
+ * @param topological Sort the commits by topological order; Can be
+ * combined with time.
+ * @param time Sort the commits by commit time; can be combined with
+ * topological.
+ * @param reverse Sort the commits in reverse order
+ * @param max_n n The upper limit of the number of commits to
+ * output. Use max_n < 0 for unlimited number of commits.
+ * @return list with S3 class git_commit objects
+ */
+SEXP attribute_hidden
+git2r_revwalk_list(
+    SEXP repo,
+    SEXP ref,
+    SEXP hide,
+    SEXP filter,
+    SEXP topological,
+    SEXP time,
+    SEXP reverse,
+    SEXP max_n)
+{
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    unsigned int sort_mode = GIT_SORT_NONE;
+    git2r_oid_buf buf = {NULL, 0, 0};
+    git2r_revwalk_iter iter = {NULL, {NULL, 0, 0}, 0};
+    git_repository *repository = NULL;
+
+    if (!Rf_isNull(ref) && git2r_arg_check_string_vec(ref))
+        git2r_error(__func__, NULL, "'ref'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(hide) && git2r_arg_check_string_vec(hide))
+        git2r_error(__func__, NULL, "'hide'", git2r_err_string_vec_arg);
+    if (git2r_revwalk_check_filter(filter))
+        git2r_error(__func__, NULL, "'filter'", git2r_err_revwalk_filter_arg);
+    if (git2r_arg_check_logical(topological))
+        git2r_error(__func__, NULL, "'topological'", git2r_err_logical_arg);
+    if (git2r_arg_check_logical(time))
+        git2r_error(__func__, NULL, "'time'", git2r_err_logical_arg);
+    if (git2r_arg_check_logical(reverse))
+        git2r_error(__func__, NULL, "'reverse'", git2r_err_logical_arg);
+    if (git2r_arg_check_integer(max_n))
+        git2r_error(__func__, NULL, "'max_n'", git2r_err_integer_arg);
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    if (git_repository_is_empty(repository)) {
+        /* No commits, create empty list */
+        PROTECT(result = Rf_allocVector(VECSXP, 0));
+        nprotect++;
+        goto cleanup;
+    }
+
+    if (LOGICAL(topological)[0])
+        sort_mode |= GIT_SORT_TOPOLOGICAL;
+    if (LOGICAL(time)[0])
+        sort_mode |= GIT_SORT_TIME;
+    if (LOGICAL(reverse)[0])
+        sort_mode |= GIT_SORT_REVERSE;
+
+    error = git2r_revwalk_iter_init(&iter, repository, ref, hide,
+                                    sort_mode, filter);
+    if (error)
+        goto cleanup;
+
+    error = git2r_revwalk_collect(&buf, &iter, INTEGER(max_n)[0]);
+    if (error)
+        goto cleanup;
+
+    /* Create list to store result */
+    PROTECT(result = Rf_allocVector(VECSXP, buf.n));
+    nprotect++;
+
+    error = git2r_revwalk_commit_list(result, &buf, repository, repo);
+
+cleanup:
+    free(buf.oids);
+    git2r_revwalk_iter_free(&iter);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * List revisions modifying a particular path.
+ *
+ * @param repo S3 class git_repository
+ * @param ref Character vector with the revisions to walk, see
+ * git2r_revwalk_spec, or R_NilValue to walk from HEAD.
+ * @param hide Character vector with the revisions to hide, or
+ * R_NilValue.
+ * @param filter List with the filter of the commits, see
+ * git2r_revwalk_iter_init, or R_NilValue.
+ * @param topological Sort the commits by topological order; Can be
+ * combined with time.
+ * @param time Sort the commits by commit time; can be combined with
+ * topological.
+ * @param reverse Sort the commits in reverse order
+ * @param max_n n The upper limit of the number of commits to
+ * output. Use max_n < 0 for unlimited number of commits.
+ * @param path Only commits modifying this path are selected
+ * @param follow Continue listing the history of the file beyond
+ * renames.
+ * @return list with S3 class git_commit objects
+ */
+SEXP attribute_hidden
+git2r_revwalk_list2 (
+    SEXP repo,
+    SEXP ref,
+    SEXP hide,
+    SEXP filter,
+    SEXP topological,
+    SEXP time,
+    SEXP reverse,
+    SEXP max_n,
+    SEXP path,
+    SEXP follow)
+{
+    int error = GIT_OK;
+    int nprotect = 0;
+    SEXP result = R_NilValue;
+    int n;
+    unsigned int sort_mode = GIT_SORT_NONE;
+    git2r_oid_buf buf = {NULL, 0, 0};
+    git2r_revwalk_iter iter = {NULL, {NULL, 0, 0}, 0};
+    git_repository *repository = NULL;
+    git_oid oid;
+    char *c_path = NULL;
+    git2r_bloom_index *index = NULL;
+    git2r_bloom_key key;
+
+    if (!Rf_isNull(ref) && git2r_arg_check_string_vec(ref))
+        git2r_error(__func__, NULL, "'ref'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(hide) && git2r_arg_check_string_vec(hide))
+        git2r_error(__func__, NULL, "'hide'", git2r_err_string_vec_arg);
+    if (git2r_revwalk_check_filter(filter))
+        git2r_error(__func__, NULL, "'filter'", git2r_err_revwalk_filter_arg);
+    if (git2r_arg_check_logical(topological))
+        git2r_error(__func__, NULL, "'topological'", git2r_err_logical_arg);
+    if (git2r_arg_check_logical(time))
+        git2r_error(__func__, NULL, "'time'", git2r_err_logical_arg);
+    if (git2r_arg_check_logical(reverse))
+        git2r_error(__func__, NULL, "'reverse'", git2r_err_logical_arg);
+    if (git2r_arg_check_integer(max_n))
+        git2r_error(__func__, NULL, "'max_n'", git2r_err_integer_arg);
+    if (git2r_arg_check_string(path))
+        git2r_error(__func__, NULL, "'path'", git2r_err_string_arg);
+    if (git2r_arg_check_logical(follow))
+        git2r_error(__func__, NULL, "'follow'", git2r_err_logical_arg);
+
+    /* The path is replaced when following a rename. */
+    c_path = strdup(CHAR(STRING_ELT(path, 0)));
+    if (!c_path) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
+        goto cleanup;
+    }
+
+    /* Open the repository. */
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    /* If there are no commits, create an empty list. */
+    if (git_repository_is_empty(repository)) {
+        PROTECT(result = Rf_allocVector(VECSXP, 0));
+        nprotect++;
+        goto cleanup;
+    }
+
+    if (LOGICAL(topological)[0])
+        sort_mode |= GIT_SORT_TOPOLOGICAL;
+    if (LOGICAL(time)[0])
+        sort_mode |= GIT_SORT_TIME;
+    if (LOGICAL(reverse)[0])
+        sort_mode |= GIT_SORT_REVERSE;
+
+    /* Use the changed-path Bloom filters, if the repository has an
+     * index, to skip commits that cannot have modified the path. */
+    error = git2r_bloom_index_load(&index, repository);
+    if (error)
+        goto cleanup;
+    git2r_bloom_key_init(&key, c_path);
+
+    /* Create a new "revwalker". */
+    error = git2r_revwalk_iter_init(&iter, repository, ref, hide,
+                                    sort_mode, filter);
+    if (error)
+        goto cleanup;
+
+    /* Walk the history once and collect the "touching" commits. */
+    n = Rf_asInteger(max_n);
+    while (n < 0 || buf.n < (size_t)n) {
+        git_commit *commit;
+        int match;
+
+        error = git2r_revwalk_iter_next(&oid, &iter);
+        if (error) {
+            if (GIT_ITEROVER == error)
+                error = GIT_OK;
+            break;
+        }
+
+        if (!git2r_bloom_index_maybe(index, &oid, &key))
+            continue;
+
+        error = git_commit_lookup(&commit, repository, &oid);
+        if (error)
+            goto cleanup;
+
+        error = git2r_revwalk_match_path(&match, commit, c_path,
+                                         iter.first_parent);
+        if (!error && match && LOGICAL(follow)[0]) {
+            error = git2r_revwalk_follow_path(&c_path, commit);
+            git2r_bloom_key_init(&key, c_path);
+        }
+        git_commit_free(commit);
+        if (error)
+            goto cleanup;
+
+        if (match) {
+            error = git2r_oid_buf_push(&buf, &oid);
+            if (error)
+                goto cleanup;
+        }
+    }
+
+    if (error)
+        goto cleanup;
+
+    /* Create the list to store the result. */
+    PROTECT(result = Rf_allocVector(VECSXP, buf.n));
+    nprotect++;
+
+    error = git2r_revwalk_commit_list(result, &buf, repository, repo);
+
+cleanup:
+    free(buf.oids);
+    free(c_path);
+    git2r_bloom_index_free(index);
+    git2r_revwalk_iter_free(&iter);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Table to give each distinct author name a number.
+ */
+typedef struct {
+    char **names;
+    size_t n;
+    size_t *slots;
+    size_t n_slots;
+} git2r_author_table;
+
+static size_t
+git2r_author_hash(
+    const char *name)
+{
+    size_t h = 2166136261u;
+
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+
+    return h;
+}
+
+/**
+ * Find the number of an author name, and add the name to the table
+ * if it is not already in the table.
+ *
+ * @param out The number of the author.
+ * @param table The table of author names.
+ * @param name The author name.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_author_table_id(
+    size_t *out,
+    git2r_author_table *table,
+    const char *name)
+{
+    size_t i;
+
+    /* Keep the load factor below one half. */
+    if (2 * (table->n + 1) > table->n_slots) {
+        size_t j, n_slots = table->n_slots ? 2 * table->n_slots : 64;
+        size_t *slots = calloc(n_slots, sizeof(size_t));
+        char **names = realloc(table->names, (n_slots / 2) * sizeof(char *));
+
+        if (!slots || !names) {
+            free(slots);
+            if (names)
+                table->names = names;
+            goto alloc_error;
+        }
+
+        /* The slots hold the number of the author plus one, and
+         * zero for an unused slot. */
+        for (j = 0; j < table->n; j++) {
+            i = git2r_author_hash(names[j]) & (n_slots - 1);
+            while (slots[i])
+                i = (i + 1) & (n_slots - 1);
+            slots[i] = j + 1;
+        }
+
+        free(table->slots);
+        table->slots = slots;
+        table->n_slots = n_slots;
+        table->names = names;
+    }
+
+    i = git2r_author_hash(name) & (table->n_slots - 1);
+    while (table->slots[i]) {
+        if (strcmp(table->names[table->slots[i] - 1], name) == 0) {
+            *out = table->slots[i] - 1;
+            return GIT_OK;
+        }
+        i = (i + 1) & (table->n_slots - 1);
+    }
+
+    table->names[table->n] = strdup(name);
+    if (!table->names[table->n])
+        goto alloc_error;
+    table->slots[i] = ++table->n;
+    *out = table->n - 1;
+
+    return GIT_OK;
+
+alloc_error:
+    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+    return GIT_ERROR;
+}
+
+static void
+git2r_author_table_free(
+    git2r_author_table *table)
+{
+    size_t i;
+
+    for (i = 0; i < table->n; i++)
+        free(table->names[i]);
+    free(table->names);
+    free(table->slots);
+}
+
+/**
+ * Days since 1970-01-01 of a date in the proleptic Gregorian
+ * calendar.
+ */
+static long
+git2r_days_from_civil(
+    long y,
+    long m,
+    long d)
+{
+    long era, yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * The date of a number of days since 1970-01-01 in the proleptic
+ * Gregorian calendar.
+ */
+static void
+git2r_civil_from_days(
+    long z,
+    long *y,
+    long *m,
+    long *d)
+{
+    long era, doe, yoe, doy, mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+/**
+ * Floor a division to minus infinity.
+ */
+static long
+git2r_floor_div(
+    git_time_t a,
+    long b)
+{
+    git_time_t q = a / b;
+
+    if ((a % b != 0) && ((a < 0) != (b < 0)))
+        q--;
+
+    return (long)q;
+}
+
+/**
+ * The first day of the period that contains a day.
+ *
+ * @param day Days since 1970-01-01.
+ * @param breaks The period: "day", "week" (starting on Monday),
+ * "month", "quarter" or "year".
+ * @return Days since 1970-01-01 of the first day in the period.
+ */
+static long
+git2r_period_start(
+    long day,
+    const char *breaks)
+{
+    long y, m, d;
+
+    if (strcmp(breaks, "day") == 0)
+        return day;
+
+    /* 1970-01-01 was a Thursday. */
+    if (strcmp(breaks, "week") == 0)
+        return day - (((day + 3) % 7) + 7) % 7;
+
+    git2r_civil_from_days(day, &y, &m, &d);
+    if (strcmp(breaks, "month") == 0)
+        return git2r_days_from_civil(y, m, 1);
+    if (strcmp(breaks, "quarter") == 0)
+        return git2r_days_from_civil(y, ((m - 1) / 3) * 3 + 1, 1);
+
+    return git2r_days_from_civil(y, 1, 1);
+}
+
+static int
+git2r_uint64_cmp(
+    const void *a,
+    const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Count the contributions in the repository.
+ *
+ * The commits are counted per period, and optionally per author,
+ * during the walk of the history, so only the counts are returned.
+ * The period of a commit is determined from the time of the author
+ * in the time zone of the author.
+ *
+ * @param repo S3 class git_repository
+ * @param breaks The period to count the commits: "day", "week",
+ * "month", "quarter" or "year".
+ * @param by_author Count the commits per author.
+ * @return list with the first day of the period as days since
+ * 1970-01-01 ('when'), the author name ('author', or NULL if not
+ * by_author) and the number of commits ('n').
+ */
+SEXP attribute_hidden
+git2r_revwalk_contributions(
+    SEXP repo,
+    SEXP breaks,
+    SEXP by_author)
+{
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    SEXP names, when, author, n;
+    size_t i, j, n_keys = 0, capacity = 0, n_groups = 0;
+    const char *c_breaks;
+    uint64_t *keys = NULL;
+    git_oid oid;
+    git2r_author_table authors = {NULL, 0, NULL, 0};
+    git2r_revwalk_iter iter = {NULL, {NULL, 0, 0}, 0};
+    git_repository *repository = NULL;
+
+    if (git2r_arg_check_string(breaks))
+        git2r_error(__func__, NULL, "'breaks'", git2r_err_string_arg);
+    if (git2r_arg_check_logical(by_author))
+        git2r_error(__func__, NULL, "'by_author'", git2r_err_logical_arg);
+    c_breaks = CHAR(STRING_ELT(breaks, 0));
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    if (!git_repository_is_empty(repository)) {
+        error = git2r_revwalk_iter_init(&iter, repository, R_NilValue,
+                                        R_NilValue, GIT_SORT_NONE,
+                                        R_NilValue);
+        if (error)
+            goto cleanup;
+
+        /* The key of a commit is the period in the high 32 bits and
+         * the author in the low 32 bits, so sorting the keys groups
+         * the commits. */
+        while (!(error = git2r_revwalk_iter_next(&oid, &iter))) {
+            git_commit *commit;
+            const git_signature *sig;
+            size_t id = 0;
+            long day;
+
+            error = git_commit_lookup(&commit, repository, &oid);
+            if (error)
+                goto cleanup;
+
+            sig = git_commit_author(commit);
+            day = git2r_floor_div(
+                sig->when.time + 60 * (git_time_t)sig->when.offset, 86400);
+            if (LOGICAL(by_author)[0])
+                error = git2r_author_table_id(&id, &authors, sig->name);
+            git_commit_free(commit);
+            if (error)
+                goto cleanup;
+
+            if (n_keys == capacity) {
+                uint64_t *k;
+
+                capacity = capacity ? 2 * capacity : 1024;
+                k = realloc(keys, capacity * sizeof(uint64_t));
+                if (!k) {
+                    giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+                    error = GIT_ERROR;
+                    goto cleanup;
+                }
+                keys = k;
+            }
+
+            keys[n_keys++] =
+                ((uint64_t)(uint32_t)(git2r_period_start(day, c_breaks) +
+                                      2147483648L) << 32) | (uint64_t)id;
+        }
+
+        if (GIT_ITEROVER != error)
+            goto cleanup;
+        error = GIT_OK;
+
+        if (n_keys)
+            qsort(keys, n_keys, sizeof(uint64_t), git2r_uint64_cmp);
+        for (i = 0; i < n_keys; i++) {
+            if (i == 0 || keys[i] != keys[i - 1])
+                n_groups++;
+        }
+    }
+
+    PROTECT(result = Rf_allocVector(VECSXP, 3));
+    nprotect++;
+    Rf_setAttrib(result, R_NamesSymbol, names = Rf_allocVector(STRSXP, 3));
+    SET_STRING_ELT(names, 0, Rf_mkChar("when"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("author"));
+    SET_STRING_ELT(names, 2, Rf_mkChar("n"));
+    SET_VECTOR_ELT(result, 0, when = Rf_allocVector(REALSXP, n_groups));
+    if (LOGICAL(by_author)[0])
+        SET_VECTOR_ELT(result, 1, author = Rf_allocVector(STRSXP, n_groups));
+    else
+        author = R_NilValue;
+    SET_VECTOR_ELT(result, 2, n = Rf_allocVector(INTSXP, n_groups));
+
+    for (i = 0, j = 0; i < n_keys; i++) {
+        if (i > 0 && keys[i] == keys[i - 1]) {
+            INTEGER(n)[j - 1]++;
+            continue;
+        }
+
+        REAL(when)[j] = (double)((long)(keys[i] >> 32) - 2147483648L);
+        if (!Rf_isNull(author)) {
+            SET_STRING_ELT(author, j,
+                           Rf_mkChar(authors.names[keys[i] & 0xffffffff]));
+        }
+        INTEGER(n)[j] = 1;
+        j++;
+    }
+
+cleanup:
+    free(keys);
+    git2r_author_table_free(&authors);
+    git2r_revwalk_iter_free(&iter);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Count the commits in the repository by weekday and hour.
+ *
+ * The weekday and hour are determined from the author time in UTC.
+ *
+ * @param repo S3 class git_repository
+ * @return integer matrix with 7 rows for the weekdays, from Sunday,
+ * and 24 columns for the hours.
+ */
+SEXP attribute_hidden
+git2r_revwalk_punch_card(
+    SEXP repo)
+{
+    int error = GIT_OK, nprotect = 0;
+    SEXP result = R_NilValue;
+    int *counts;
+    size_t i;
+    git_oid oid;
+    git2r_revwalk_iter iter = {NULL, {NULL, 0, 0}, 0};
+    git_repository *repository = NULL;
+
+    repository = git2r_repository_open(repo);
+    if (!repository)
+        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+
+    PROTECT(result = Rf_allocMatrix(INTSXP, 7, 24));
+    nprotect++;
+    counts = INTEGER(result);
+    for (i = 0; i < 7 * 24; i++)
+        counts[i] = 0;
+
+    if (git_repository_is_empty(repository))
+        goto cleanup;
+
+    error = git2r_revwalk_iter_init(&iter, repository, R_NilValue,
+                                    R_NilValue, GIT_SORT_NONE, R_NilValue);
+    if (error)
+        goto cleanup;
+
+    while (!(error = git2r_revwalk_iter_next(&oid, &iter))) {
+        git_commit *commit;
+        git_time_t t;
+        long day, hour, weekday;
+
+        error = git_commit_lookup(&commit, repository, &oid);
+        if (error)
+            goto cleanup;
+        t = git_commit_author(commit)->when.time;
+        git_commit_free(commit);
+
+        day = git2r_floor_div(t, 86400);
+        hour = (long)((t - (git_time_t)day * 86400) / 3600);
+
+        /* 1970-01-01 was a Thursday, and Sunday is weekday 0. */
+        weekday = (((day + 4) % 7) + 7) % 7;
+        counts[weekday + 7 * hour]++;
+    }
+
+    if (GIT_ITEROVER == error)
+        error = GIT_OK;
+
+cleanup:
+    git2r_revwalk_iter_free(&iter);
+    git2r_repository_free(repository);
+
+    if (nprotect)
+        UNPROTECT(nprotect);
+
+    if (error)
+        git2r_error(__func__, git_error_last(), NULL, NULL);
+
+    return result;
+}
+
+/**
+ * Names of the columns in the commit log data.frame.
+ */
+static const char *git2r_revwalk_df_columns[] = {
+    "sha", "summary", "message", "author", "email", "when",
+    "committer", "committer_email", "committer_when", "parents",
+    "tree", NULL};
+
+enum {
+    git2r_revwalk_df__sha,
+    git2r_revwalk_df__summary,
+    git2r_revwalk_df__message,
+    git2r_revwalk_df__author,
+    git2r_revwalk_df__email,
+    git2r_revwalk_df__when,
+    git2r_revwalk_df__committer,
+    git2r_revwalk_df__committer_email,
+    git2r_revwalk_df__committer_when,
+    git2r_revwalk_df__parents,
+    git2r_revwalk_df__tree};
+
+/**
+ * A signature in a commit, as pointers into the commit data that
+ * are not necessarily nul-terminated.
+ */
+typedef struct {
+    const char *name;
+    size_t name_len;
+    const char *email;
+    size_t email_len;
+    git_time_t time;
+} git2r_commit_signature;
+
+/**
+ * The fields of a commit that fill the columns of the commit log.
+ */
+typedef struct {
+    git_oid tree;
+    int parents;
+    git2r_commit_signature author;
+    git2r_commit_signature committer;
+    const char *summary;
+    const char *message;
+} git2r_commit_fields;
+
+/**
+ * Check if a character is white space, as 'git__isspace' in libgit2.
+ *
+ * @param c The character.
+ * @return 1 if white space, else 0.
+ */
+static int
+git2r_commit_isspace(
+    char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' ||
+        c == '\f' || c == '\r';
+}
+
+/**
+ * Parse a signature line, 'Name <email> time offset', in a commit
+ * header. As in libgit2, the email is within the last '<' and the
+ * last '>', the name and the email are trimmed of white space, and
+ * the time may be negative.
+ *
+ * @param out The parsed signature.
+ * @param line The start of the signature, after the keyword.
+ * @param eol The end of the line.
+ * @return 0 on success, else -1.
+ */
+static int
+git2r_commit_signature_parse(
+    git2r_commit_signature *out,
+    const char *line,
+    const char *eol)
+{
+    const char *lt, *gt, *p;
+    size_t i;
+    int negative = 0;
+
+    for (i = (size_t)(eol - line); i > 0 && line[i - 1] != '>'; i--)
+        ;
+    if (!i)
+        return -1;
+    gt = line + i - 1;
+    for (i--; i > 0 && line[i - 1] != '<'; i--)
+        ;
+    if (!i)
+        return -1;
+    lt = line + i - 1;
+
+    for (p = line; p < lt && git2r_commit_isspace(*p); p++)
+        ;
+    out->name = p;
+    out->name_len = (size_t)(lt - p);
+    while (out->name_len && git2r_commit_isspace(p[out->name_len - 1]))
+        out->name_len--;
+
+    for (p = lt + 1; p < gt && git2r_commit_isspace(*p); p++)
+        ;
+    out->email = p;
+    out->email_len = (size_t)(gt - p);
+    while (out->email_len && git2r_commit_isspace(p[out->email_len - 1]))
+        out->email_len--;
+
+    out->time = 0;
+    for (p = gt + 1; p < eol && git2r_commit_isspace(*p); p++)
+        ;
+    if (p < eol && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    for (; p < eol && *p >= '0' && *p <= '9'; p++)
+        out->time = out->time * 10 + (*p - '0');
+    if (negative)
+        out->time = -out->time;
+
+    return 0;
+}
+
+/**
+ * Parse the header of a raw commit, without the message.
+ *
+ * @param out The fields to fill. The summary and message are set to
+ * NULL.
+ * @param data The raw commit.
+ * @param size The size of the raw commit.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_commit_header_parse(
+    git2r_commit_fields *out,
+    const char *data,
+    size_t size)
+{
+    const char *p = data, *end = data + size;
+    int tree = 0, author = 0, committer = 0;
+
+    memset(out, 0, sizeof(git2r_commit_fields));
+
+    /* The header ends at the first empty line. Continuation lines,
+     * e.g. in a 'gpgsig' field, start with a space and are skipped
+     * along with other fields. */
+    while (p < end && *p != '\n') {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        size_t len;
+
+        if (!eol)
+            eol = end;
+        len = (size_t)(eol - p);
+
+        if (len >= 5 + GIT_OID_HEXSZ && !strncmp(p, "tree ", 5)) {
+            tree = !git_oid_fromstrn(&(out->tree), p + 5, GIT_OID_HEXSZ);
+        } else if (len > 7 && !strncmp(p, "parent ", 7)) {
+            out->parents++;
+        } else if (len > 7 && !strncmp(p, "author ", 7)) {
+            author = !git2r_commit_signature_parse(&(out->author), p + 7, eol);
+        } else if (len > 10 && !strncmp(p, "committer ", 10)) {
+            committer = !git2r_commit_signature_parse(
+                &(out->committer), p + 10, eol);
+        }
+
+        p = eol + 1;
+    }
+
+    if (!tree || !author || !committer) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_commit_header);
+        return GIT_ERROR;
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Get the fields of a parsed commit.
+ *
+ * @param out The fields to fill, with pointers into the commit.
+ * @param commit The commit.
+ * @param summary Get the summary.
+ * @param message Get the message.
+ */
+static void
+git2r_commit_fields_get(
+    git2r_commit_fields *out,
+    git_commit *commit,
+    int summary,
+    int message)
+{
+    const git_signature *signature;
+
+    git_oid_cpy(&(out->tree), git_commit_tree_id(commit));
+    out->parents = (int)git_commit_parentcount(commit);
+
+    signature = git_commit_author(commit);
+    out->author.name = signature->name;
+    out->author.name_len = strlen(signature->name);
+    out->author.email = signature->email;
+    out->author.email_len = strlen(signature->email);
+    out->author.time = signature->when.time;
+
+    signature = git_commit_committer(commit);
+    out->committer.name = signature->name;
+    out->committer.name_len = strlen(signature->name);
+    out->committer.email = signature->email;
+    out->committer.email_len = strlen(signature->email);
+    out->committer.time = signature->when.time;
+
+    out->summary = summary ? git_commit_summary(commit) : NULL;
+    out->message = message ? git_commit_message(commit) : NULL;
+}
+
+/**
+ * Set row 'i' in the columns of the commit log.
+ *
+ * @param result The list with the columns.
+ * @param columns The column of each item in 'result'.
+ * @param n_columns The number of columns.
+ * @param i The row.
+ * @param oid The id of the commit.
+ * @param fields The fields of the commit.
+ */
+static void
+git2r_revwalk_df_set_row(
+    SEXP result,
+    const int *columns,
+    size_t n_columns,
+    size_t i,
+    const git_oid *oid,
+    const git2r_commit_fields *fields)
+{
+    size_t j;
+    char sha[GIT_OID_HEXSZ + 1];
+
+    for (j = 0; j < n_columns; j++) {
+        SEXP column = VECTOR_ELT(result, j);
+
+        switch (columns[j]) {
+        case git2r_revwalk_df__sha:
+        case git2r_revwalk_df__tree:
+            git_oid_fmt(sha, columns[j] == git2r_revwalk_df__sha ?
+                        oid : &(fields->tree));
+            sha[GIT_OID_HEXSZ] = '\0';
+            SET_STRING_ELT(column, i, Rf_mkChar(sha));
+            break;
+        case git2r_revwalk_df__summary:
+            SET_STRING_ELT(column, i, fields->summary ?
+                           Rf_mkChar(fields->summary) : NA_STRING);
+            break;
+        case git2r_revwalk_df__message:
+            SET_STRING_ELT(column, i, fields->message ?
+                           Rf_mkChar(fields->message) : NA_STRING);
+            break;
+        case git2r_revwalk_df__author:
+            SET_STRING_ELT(column, i, Rf_mkCharLen(
+                               fields->author.name,
+                               (int)fields->author.name_len));
+            break;
+        case git2r_revwalk_df__email:
+            SET_STRING_ELT(column, i, Rf_mkCharLen(
+                               fields->author.email,
+                               (int)fields->author.email_len));
+            break;
+        case git2r_revwalk_df__when:
+            REAL(column)[i] = (double)fields->author.time;
+            break;
+        case git2r_revwalk_df__committer:
+            SET_STRING_ELT(column, i, Rf_mkCharLen(
+                               fields->committer.name,
+                               (int)fields->committer.name_len));
+            break;
+        case git2r_revwalk_df__committer_email:
+            SET_STRING_ELT(column, i, Rf_mkCharLen(
+                               fields->committer.email,
+                               (int)fields->committer.email_len));
+            break;
+        case git2r_revwalk_df__committer_when:
+            REAL(column)[i] = (double)fields->committer.time;
+            break;
+        case git2r_revwalk_df__parents:
+            INTEGER(column)[i] = fields->parents;
+            break;
+        }
+    }
+}
+
+/**
+ * Index of a string of a commit, in the strings of a worker.
+ */
+enum {
+    git2r_commit_row__author,
+    git2r_commit_row__author_email,
+    git2r_commit_row__committer,
+    git2r_commit_row__committer_email,
+    git2r_commit_row__summary,
+    git2r_commit_row__message,
+    git2r_commit_row__n};
+
+/**
+ * The fields of a commit decoded by a worker thread. The strings
+ * are offsets into the nul-terminated strings of the worker, or
+ * SIZE_MAX for NA.
+ */
+typedef struct {
+    git_oid tree;
+    int parents;
+    git_time_t author_time;
+    git_time_t committer_time;
+    size_t strings[git2r_commit_row__n];
+} git2r_commit_row;
+
+/**
+ * Work item for a thread that decodes a range of commits.
+ */
+typedef struct {
+    const char *path;
+    const git_oid *oids;
+    git2r_commit_row *rows;
+    size_t start;
+    size_t end;
+    int summary;
+    int message;
+    char *strings;
+    size_t strings_size;
+    size_t strings_capacity;
+    int error;
+    char *error_message;
+} git2r_revwalk_worker;
+
+/**
+ * Append a string to the strings of a worker.
+ *
+ * @param out The offset of the string, or SIZE_MAX if 'str' is NULL.
+ * @param worker The worker.
+ * @param str The string to append, or NULL.
+ * @param len The length of the string.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_worker_append(
+    size_t *out,
+    git2r_revwalk_worker *worker,
+    const char *str,
+    size_t len)
+{
+    if (!str) {
+        *out = SIZE_MAX;
+        return GIT_OK;
+    }
+
+    if (worker->strings_size + len + 1 > worker->strings_capacity) {
+        size_t capacity = worker->strings_capacity ?
+            worker->strings_capacity : 4096;
+        char *strings;
+
+        while (worker->strings_size + len + 1 > capacity)
+            capacity *= 2;
+        strings = realloc(worker->strings, capacity);
+        if (!strings)
+            return GIT_ERROR;
+
+        worker->strings = strings;
+        worker->strings_capacity = capacity;
+    }
+
+    *out = worker->strings_size;
+    memcpy(worker->strings + worker->strings_size, str, len);
+    worker->strings[worker->strings_size + len] = '\0';
+    worker->strings_size += len + 1;
+
+    return GIT_OK;
+}
+
+/**
+ * Copy the fields of a commit to its row.
+ */
+static int
+git2r_revwalk_worker_store(
+    git2r_revwalk_worker *worker,
+    git2r_commit_row *row,
+    const git2r_commit_fields *fields)
+{
+    int error;
+    size_t *s = row->strings;
+
+    git_oid_cpy(&(row->tree), &(fields->tree));
+    row->parents = fields->parents;
+    row->author_time = fields->author.time;
+    row->committer_time = fields->committer.time;
+
+    error = git2r_revwalk_worker_append(
+        &s[git2r_commit_row__author], worker,
+        fields->author.name, fields->author.name_len);
+    if (!error) {
+        error = git2r_revwalk_worker_append(
+            &s[git2r_commit_row__author_email], worker,
+            fields->author.email, fields->author.email_len);
+    }
+    if (!error) {
+        error = git2r_revwalk_worker_append(
+            &s[git2r_commit_row__committer], worker,
+            fields->committer.name, fields->committer.name_len);
+    }
+    if (!error) {
+        error = git2r_revwalk_worker_append(
+            &s[git2r_commit_row__committer_email], worker,
+            fields->committer.email, fields->committer.email_len);
+    }
+    if (!error) {
+        error = git2r_revwalk_worker_append(
+            &s[git2r_commit_row__summary], worker, fields->summary,
+            fields->summary ? strlen(fields->summary) : 0);
+    }
+    if (!error) {
+        error = git2r_revwalk_worker_append(
+            &s[git2r_commit_row__message], worker, fields->message,
+            fields->message ? strlen(fields->message) : 0);
+    }
+
+    return error;
+}
+
+/**
+ * Decode a range of commits in a worker thread.
+ *
+ * The worker opens its own repository handle and must not call the
+ * R API. The error message, if any, is copied since the libgit2
+ * error is local to the thread.
+ *
+ * @param payload The git2r_revwalk_worker.
+ * @return NULL
+ */
+static void *
+git2r_revwalk_worker_run(
+    void *payload)
+{
+    git2r_revwalk_worker *worker = payload;
+    git_repository *repository = NULL;
+    git_odb *odb = NULL;
+    size_t i;
+    int error;
+
+    error = git_repository_open(&repository, worker->path);
+    if (!error && !worker->summary && !worker->message)
+        error = git_repository_odb(&odb, repository);
+
+    for (i = worker->start; !error && i < worker->end; i++) {
+        git2r_commit_fields fields;
+
+        if (odb) {
+            git_odb_object *obj;
 
-    repository = git2r_repository_open(repo);
-    if (!repository)
-        git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
+            error = git_odb_read(&obj, odb, &(worker->oids[i]));
+            if (error)
+                break;
 
-    if (git_repository_is_empty(repository)) {
-        /* No commits, create empty list */
-        PROTECT(result = Rf_allocVector(VECSXP, 0));
-        nprotect++;
-        goto cleanup;
-    }
+            error = git2r_commit_header_parse(
+                &fields, git_odb_object_data(obj), git_odb_object_size(obj));
+            if (!error)
+                error = git2r_revwalk_worker_store(worker, &(worker->rows[i]), &fields);
 
-    if (LOGICAL(topological)[0])
-        sort_mode |= GIT_SORT_TOPOLOGICAL;
-    if (LOGICAL(time)[0])
-        sort_mode |= GIT_SORT_TIME;
-    if (LOGICAL(reverse)[0])
-        sort_mode |= GIT_SORT_REVERSE;
+            git_odb_object_free(obj);
+        } else {
+            git_commit *commit;
 
-    error = git_revwalk_new(&walker, repository);
-    if (error)
-        goto cleanup;
+            error = git_commit_lookup(&commit, repository, &(worker->oids[i]));
+            if (error)
+                break;
 
-    git2r_oid_from_sha_sexp(sha, &oid);
-    error = git_revwalk_push(walker, &oid);
-    if (error)
-        goto cleanup;
-    git_revwalk_sorting(walker, sort_mode);
+            git2r_commit_fields_get(&fields, commit, worker->summary,
+                                    worker->message);
+            error = git2r_revwalk_worker_store(worker, &(worker->rows[i]), &fields);
 
-    /* Count number of revisions before creating the list */
-    n = git2r_revwalk_count(walker, INTEGER(max_n)[0]);
+            git_commit_free(commit);
+        }
+    }
 
-    /* Create list to store result */
-    PROTECT(result = Rf_allocVector(VECSXP, n));
-    nprotect++;
+    if (error) {
+        const git_error *err = git_error_last();
+        const char *msg = err && err->message ?
+            err->message : git2r_err_alloc_memory_buffer;
 
-    git_revwalk_reset(walker);
-    error = git_revwalk_push(walker, &oid);
-    if (error)
+        worker->error = error;
+        worker->error_message = malloc(strlen(msg) + 1);
+        if (worker->error_message)
+            strcpy(worker->error_message, msg);
+    }
+
+    git_odb_free(odb);
+    git_repository_free(repository);
+
+    return NULL;
+}
+
+/**
+ * Decode commits in worker threads and fill the columns of the
+ * commit log.
+ *
+ * The commits are split in one contiguous range per thread. The
+ * workers write to preallocated rows and their own strings, and the
+ * columns are filled from the rows in the calling thread when all
+ * workers have finished.
+ *
+ * @param result The list with the columns.
+ * @param columns The column of each item in 'result'.
+ * @param n_columns The number of columns.
+ * @param repository The repository.
+ * @param buf The ids of the commits.
+ * @param summary Decode the summary.
+ * @param message Decode the message.
+ * @param n_threads The number of threads.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_df_threads(
+    SEXP result,
+    const int *columns,
+    size_t n_columns,
+    git_repository *repository,
+    const git2r_oid_buf *buf,
+    int summary,
+    int message,
+    size_t n_threads)
+{
+    int error = GIT_OK;
+    size_t i, j;
+    git2r_commit_row *rows = NULL;
+    git2r_revwalk_worker *workers = NULL;
+
+    rows = malloc(buf->n * sizeof(git2r_commit_row));
+    workers = calloc(n_threads, sizeof(git2r_revwalk_worker));
+    if (!rows || !workers) {
+        giterr_set_str(GIT_ERROR_NONE, git2r_err_alloc_memory_buffer);
+        error = GIT_ERROR;
         goto cleanup;
-    git_revwalk_sorting(walker, sort_mode);
+    }
 
-    for (i = 0; i < n; i++) {
-        git_commit *commit;
-        SEXP item;
-        git_oid oid;
+    for (i = 0; i < n_threads; i++) {
+        workers[i].path = git_repository_path(repository);
+        workers[i].oids = buf->oids;
+        workers[i].rows = rows;
+        workers[i].start = buf->n * i / n_threads;
+        workers[i].end = buf->n * (i + 1) / n_threads;
+        workers[i].summary = summary;
+        workers[i].message = message;
+    }
 
-        error = git_revwalk_next(&oid, walker);
-        if (error) {
-            if (GIT_ITEROVER == error)
-                error = GIT_OK;
-            goto cleanup;
-        }
+    git2r_thread_run(git2r_revwalk_worker_run, workers, n_threads,
+                     sizeof(git2r_revwalk_worker));
 
-        error = git_commit_lookup(&commit, repository, &oid);
-        if (error)
+    for (i = 0; i < n_threads; i++) {
+        if (workers[i].error) {
+            giterr_set_str(GIT_ERROR_NONE, workers[i].error_message ?
+                           workers[i].error_message :
+                           git2r_err_alloc_memory_buffer);
+            error = GIT_ERROR;
             goto cleanup;
+        }
+    }
 
-        SET_VECTOR_ELT(
-            result,
-            i,
-            item = Rf_mkNamed(VECSXP, git2r_S3_items__git_commit));
-        Rf_setAttrib(item, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_commit));
-        git2r_commit_init(commit, repo, item);
-        git_commit_free(commit);
+    for (i = 0; i < n_threads; i++) {
+        const char *strings = workers[i].strings;
+
+        for (j = workers[i].start; j < workers[i].end; j++) {
+            const git2r_commit_row *row = &rows[j];
+            const size_t *s = row->strings;
+            git2r_commit_fields fields;
+
+            git_oid_cpy(&(fields.tree), &(row->tree));
+            fields.parents = row->parents;
+            fields.author.name = strings + s[git2r_commit_row__author];
+            fields.author.name_len = strlen(fields.author.name);
+            fields.author.email = strings + s[git2r_commit_row__author_email];
+            fields.author.email_len = strlen(fields.author.email);
+            fields.author.time = row->author_time;
+            fields.committer.name = strings + s[git2r_commit_row__committer];
+            fields.committer.name_len = strlen(fields.committer.name);
+            fields.committer.email = strings + s[git2r_commit_row__committer_email];
+            fields.committer.email_len = strlen(fields.committer.email);
+            fields.committer.time = row->committer_time;
+            fields.summary = s[git2r_commit_row__summary] == SIZE_MAX ?
+                NULL : strings + s[git2r_commit_row__summary];
+            fields.message = s[git2r_commit_row__message] == SIZE_MAX ?
+                NULL : strings + s[git2r_commit_row__message];
+
+            git2r_revwalk_df_set_row(result, columns, n_columns, j,
+                                     &(buf->oids[j]), &fields);
+        }
     }
 
 cleanup:
-    git_revwalk_free(walker);
-    git_repository_free(repository);
+    for (i = 0; workers && i < n_threads; i++) {
+        free(workers[i].strings);
+        free(workers[i].error_message);
+    }
+    free(workers);
+    free(rows);
 
-    if (nprotect)
-        UNPROTECT(nprotect);
+    return error;
+}
 
-    if (error)
-        git2r_error(__func__, git_error_last(), NULL, NULL);
+/**
+ * Set the number of parents to zero for the commits at the boundary
+ * of a shallow repository, as the grafts that libgit2 applies when
+ * it parses a commit. The parents are counted from the raw commit
+ * headers, which still list the missing parents.
+ *
+ * @param result The list with the columns.
+ * @param columns The column of each item in 'result'.
+ * @param n_columns The number of columns.
+ * @param repository The repository.
+ * @param buf The ids of the commits in the rows.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_df_shallow(
+    SEXP result,
+    const int *columns,
+    size_t n_columns,
+    git_repository *repository,
+    const git2r_oid_buf *buf)
+{
+    int error;
+    size_t i, j, value;
+    git2r_oidmap boundary = {NULL, NULL, 0, 0};
 
-    return result;
+    if (!git_repository_is_shallow(repository))
+        return GIT_OK;
+
+    error = git2r_shallow_read(&boundary, repository);
+    for (j = 0; !error && j < n_columns; j++) {
+        if (columns[j] != git2r_revwalk_df__parents)
+            continue;
+        for (i = 0; i < buf->n; i++) {
+            if (git2r_oidmap_get(&value, &boundary, &(buf->oids[i])))
+                INTEGER(VECTOR_ELT(result, j))[i] = 0;
+        }
+    }
+
+    git2r_oidmap_free(&boundary);
+
+    return error;
 }
 
 /**
- * List revisions modifying a particular path.
+ * List revisions as columns
+ *
+ * The columns are allocated once with the number of revisions and
+ * filled directly from the commits, without creating an S3 object
+ * per commit. Unless the summary or the message is requested, the
+ * commits are not parsed by libgit2: only the header of the raw
+ * commit is read, so the message is never copied.
  *
  * @param repo S3 class git_repository
- * @param sha id of the commit to start from.
+ * @param ref Character vector with the revisions to walk, see
+ * git2r_revwalk_spec, or R_NilValue to walk from HEAD.
+ * @param hide Character vector with the revisions to hide, or
+ * R_NilValue.
+ * @param filter List with the filter of the commits, see
+ * git2r_revwalk_iter_init, or R_NilValue.
  * @param topological Sort the commits by topological order; Can be
  * combined with time.
  * @param time Sort the commits by commit time; can be combined with
@@ -220,33 +3125,42 @@ cleanup:
  * @param reverse Sort the commits in reverse order
  * @param max_n n The upper limit of the number of commits to
  * output. Use max_n < 0 for unlimited number of commits.
- * @param path Only commits modifying this path are selected
- * @return list with S3 class git_commit objects
+ * @param columns Character vector with the columns to return, any
+ * of: sha, summary, message, author, email, when, committer,
+ * committer_email, committer_when, parents and tree.
+ * @param threads The number of threads to decode the commits. One
+ * thread is used if libgit2 is built without thread support.
+ * @return named list with the columns.
  */
 SEXP attribute_hidden
-git2r_revwalk_list2 (
+git2r_revwalk_df(
     SEXP repo,
-    SEXP sha,
+    SEXP ref,
+    SEXP hide,
+    SEXP filter,
     SEXP topological,
     SEXP time,
     SEXP reverse,
     SEXP max_n,
-    SEXP path)
+    SEXP columns,
+    SEXP threads)
 {
-    int i = 0;
-    int error = GIT_OK;
-    int nprotect = 0;
-    SEXP result = R_NilValue;
-    int n;
+    int error = GIT_OK, nprotect = 0, summary = 0, message = 0;
+    int c_columns[sizeof(git2r_revwalk_df_columns) / sizeof(char *)];
+    SEXP result = R_NilValue, names;
+    size_t i, j, n_columns, n_threads;
     unsigned int sort_mode = GIT_SORT_NONE;
-    git_revwalk *walker = NULL;
+    git2r_oid_buf buf = {NULL, 0, 0};
+    git2r_revwalk_iter iter = {NULL, {NULL, 0, 0}, 0};
     git_repository *repository = NULL;
-    git_oid oid;
-    git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
-    git_pathspec *ps = NULL;
-
-    if (git2r_arg_check_sha(sha))
-        git2r_error(__func__, NULL, "'sha'", git2r_err_sha_arg);
+    git_odb *odb = NULL;
+
+    if (!Rf_isNull(ref) && git2r_arg_check_string_vec(ref))
+        git2r_error(__func__, NULL, "'ref'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(hide) && git2r_arg_check_string_vec(hide))
+        git2r_error(__func__, NULL, "'hide'", git2r_err_string_vec_arg);
+    if (git2r_revwalk_check_filter(filter))
+        git2r_error(__func__, NULL, "'filter'", git2r_err_revwalk_filter_arg);
     if (git2r_arg_check_logical(topological))
         git2r_error(__func__, NULL, "'topological'", git2r_err_logical_arg);
     if (git2r_arg_check_logical(time))
@@ -255,144 +3169,145 @@ git2r_revwalk_list2 (
         git2r_error(__func__, NULL, "'reverse'", git2r_err_logical_arg);
     if (git2r_arg_check_integer(max_n))
         git2r_error(__func__, NULL, "'max_n'", git2r_err_integer_arg);
-    if (git2r_arg_check_string(path))
-        git2r_error(__func__, NULL, "'path'", git2r_err_string_arg);
+    if (git2r_arg_check_string_vec(columns))
+        git2r_error(__func__, NULL, "'columns'", git2r_err_string_vec_arg);
+    if (git2r_arg_check_integer_gte_zero(threads))
+        git2r_error(__func__, NULL, "'threads'", git2r_err_integer_gte_zero_arg);
+
+    /* Map the names of the columns, where each column may occur
+     * once. */
+    n_columns = (size_t)Rf_xlength(columns);
+    if (n_columns >= sizeof(c_columns) / sizeof(int))
+        git2r_error(__func__, NULL, "'columns'", git2r_err_revwalk_columns_arg);
+    for (i = 0; i < n_columns; i++) {
+        const char *name = CHAR(STRING_ELT(columns, i));
+
+        for (j = 0; git2r_revwalk_df_columns[j]; j++) {
+            if (!strcmp(name, git2r_revwalk_df_columns[j]))
+                break;
+        }
+        c_columns[i] = (int)j;
+
+        if (!git2r_revwalk_df_columns[j] ||
+            STRING_ELT(columns, i) == NA_STRING)
+            git2r_error(__func__, NULL, "'columns'", git2r_err_revwalk_columns_arg);
+        for (j = 0; j < i; j++) {
+            if (c_columns[j] == c_columns[i])
+                git2r_error(__func__, NULL, "'columns'", git2r_err_revwalk_columns_arg);
+        }
 
-    /* Set up git pathspec. */
-    error = git2r_copy_string_vec(&(diffopts.pathspec), path);
-    if (error || !diffopts.pathspec.count)
-        goto cleanup;
-    error = git_pathspec_new(&ps, &diffopts.pathspec);
-    if (error)
-        goto cleanup;
+        if (c_columns[i] == git2r_revwalk_df__summary)
+            summary = 1;
+        if (c_columns[i] == git2r_revwalk_df__message)
+            message = 1;
+    }
 
-    /* Open the repository. */
     repository = git2r_repository_open(repo);
     if (!repository)
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
-    /* If there are no commits, create an empty list. */
-    if (git_repository_is_empty(repository)) {
-        PROTECT(result = Rf_allocVector(VECSXP, 0));
-        nprotect++;
-        goto cleanup;
-    }
-
-    if (LOGICAL(topological)[0])
-        sort_mode |= GIT_SORT_TOPOLOGICAL;
-    if (LOGICAL(time)[0])
-        sort_mode |= GIT_SORT_TIME;
-    if (LOGICAL(reverse)[0])
-        sort_mode |= GIT_SORT_REVERSE;
-
-    /* Create a new "revwalker". */
-    error = git_revwalk_new(&walker, repository);
-    if (error)
-        goto cleanup;
+    if (!git_repository_is_empty(repository)) {
+        if (LOGICAL(topological)[0])
+            sort_mode |= GIT_SORT_TOPOLOGICAL;
+        if (LOGICAL(time)[0])
+            sort_mode |= GIT_SORT_TIME;
+        if (LOGICAL(reverse)[0])
+            sort_mode |= GIT_SORT_REVERSE;
 
-    git2r_oid_from_sha_sexp(sha, &oid);
-    error = git_revwalk_push(walker, &oid);
-    if (error)
-        goto cleanup;
-    git_revwalk_sorting(walker, sort_mode);
-    error = git_revwalk_push_head(walker);
-    if (error)
-        goto cleanup;
+        error = git2r_revwalk_iter_init(&iter, repository, ref, hide,
+                                        sort_mode, filter);
+        if (error)
+            goto cleanup;
 
-    n = Rf_asInteger(max_n);
-    if (n < 0) {
-        /* Count number of revisions before creating the list. */
-        n = git2r_revwalk_count(walker, n);
+        error = git2r_revwalk_collect(&buf, &iter, INTEGER(max_n)[0]);
+        if (error)
+            goto cleanup;
     }
 
-    /* Restart the revwalker. */
-    git_revwalk_reset(walker);
-    git_revwalk_sorting(walker, sort_mode);
-    error = git_revwalk_push(walker, &oid);
-    if (error)
-        goto cleanup;
-
-    /* Create the list to store the result. */
-    PROTECT(result = Rf_allocVector(VECSXP, n));
+    PROTECT(result = Rf_allocVector(VECSXP, n_columns));
     nprotect++;
+    Rf_setAttrib(result, R_NamesSymbol, names = Rf_allocVector(STRSXP, n_columns));
+    for (i = 0; i < n_columns; i++) {
+        SEXPTYPE type;
+
+        switch (c_columns[i]) {
+        case git2r_revwalk_df__when:
+        case git2r_revwalk_df__committer_when:
+            type = REALSXP;
+            break;
+        case git2r_revwalk_df__parents:
+            type = INTSXP;
+            break;
+        default:
+            type = STRSXP;
+            break;
+        }
 
-    while (i < n) {
-        git_commit *commit;
-        SEXP item;
-        git_oid oid;
-	unsigned int parents, unmatched;
-        int match;
+        SET_STRING_ELT(names, i, Rf_mkChar(git2r_revwalk_df_columns[c_columns[i]]));
+        SET_VECTOR_ELT(result, i, Rf_allocVector(type, buf.n));
+    }
 
-        error = git_revwalk_next(&oid, walker);
-        if (error) {
-            if (GIT_ITEROVER == error)
-                error = GIT_OK;
-            goto cleanup;
-        }
+    n_threads = git2r_thread_count(INTEGER(threads)[0], buf.n);
+    if (n_threads > 1) {
+        error = git2r_revwalk_df_threads(result, c_columns, n_columns,
+                                         repository, &buf, summary,
+                                         message, n_threads);
+        if (!error)
+            error = git2r_revwalk_df_shallow(result, c_columns, n_columns,
+                                             repository, &buf);
+        goto cleanup;
+    }
 
-        error = git_commit_lookup(&commit, repository, &oid);
+    if (!summary && !message) {
+        error = git_repository_odb(&odb, repository);
         if (error)
             goto cleanup;
+    }
 
-        /* Check whether it is a "touching" commit---that is, a commit
-	   that has modified the selected path. */
-        parents = git_commit_parentcount(commit);
-        unmatched = parents;
-        if (parents == 0) {
-	    git_tree *tree;
-	    if ((error = git_commit_tree(&tree, commit)) < 0) {
-                git_commit_free(commit);
-                goto cleanup;
-            }
-            error = git_pathspec_match_tree(
-                NULL, tree, GIT_PATHSPEC_NO_MATCH_ERROR, ps);
-	    git_tree_free(tree);
-	    if (error == GIT_ENOTFOUND) {
-                error = 0;
-	        unmatched = 1;
-            } else if (error < 0) {
-                git_commit_free(commit);
+    for (i = 0; i < buf.n; i++) {
+        git2r_commit_fields fields;
+
+        if (odb) {
+            git_odb_object *obj;
+
+            error = git_odb_read(&obj, odb, &(buf.oids[i]));
+            if (error)
                 goto cleanup;
+
+            error = git2r_commit_header_parse(
+                &fields, git_odb_object_data(obj), git_odb_object_size(obj));
+            if (!error) {
+                git2r_revwalk_df_set_row(result, c_columns, n_columns,
+                                         i, &(buf.oids[i]), &fields);
             }
-	} else if (parents == 1) {
-            if ((error = git2r_match_with_parent(&match, commit, 0, &diffopts)) < 0) {
-                git_commit_free(commit);
+
+            git_odb_object_free(obj);
+        } else {
+            git_commit *commit;
+
+            error = git_commit_lookup(&commit, repository, &(buf.oids[i]));
+            if (error)
                 goto cleanup;
-            }
-            unmatched = match ? 0 : 1;
-	} else {
-            unsigned int j;
 
-            for (j = 0; j < parents; j++) {
-                if ((error = git2r_match_with_parent(&match, commit, j, &diffopts)) < 0) {
-                    git_commit_free(commit);
-                    goto cleanup;
-                }
-                if (match && unmatched)
-                    unmatched--;
-            }
-	}
+            git2r_commit_fields_get(&fields, commit, summary, message);
+            git2r_revwalk_df_set_row(result, c_columns, n_columns,
+                                     i, &(buf.oids[i]), &fields);
 
-        if (unmatched > 0) {
             git_commit_free(commit);
-            continue;
         }
 
-        SET_VECTOR_ELT(
-            result,
-            i,
-            item = Rf_mkNamed(VECSXP, git2r_S3_items__git_commit));
-        Rf_setAttrib(item, R_ClassSymbol,
-                     Rf_mkString(git2r_S3_class__git_commit));
-        git2r_commit_init(commit, repo, item);
-        git_commit_free(commit);
-        i++;
+        if (error)
+            goto cleanup;
     }
 
+    error = git2r_revwalk_df_shallow(result, c_columns, n_columns,
+                                     repository, &buf);
+
 cleanup:
-    free(diffopts.pathspec.strings);
-    git_revwalk_free(walker);
-    git_repository_free(repository);
+    free(buf.oids);
+    git_odb_free(odb);
+    git2r_revwalk_iter_free(&iter);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -404,112 +3319,131 @@ cleanup:
 }
 
 /**
- * Get list with contributions.
+ * Check if each commit in 'known' is one of the commits in 'tips' or
+ * an ancestor of one of them.
+ *
+ * @param out 1 if all commits in 'known' are reachable, else 0.
+ * @param repository The repository.
+ * @param tips The ids of the tips.
+ * @param known Character vector with the sha of the commits.
+ * @return 0 on success, or an error code.
+ */
+static int
+git2r_revwalk_tips_reachable(
+    int *out,
+    git_repository *repository,
+    const git2r_oid_buf *tips,
+    SEXP known)
+{
+    size_t i, j;
+
+    *out = 1;
+    for (i = 0; *out && i < (size_t)Rf_xlength(known); i++) {
+        git_oid oid;
+        int error = git_oid_fromstr(&oid, CHAR(STRING_ELT(known, i)));
+
+        if (error)
+            return error;
+
+        *out = 0;
+        for (j = 0; !*out && j < tips->n; j++) {
+            if (git_oid_equal(&oid, &(tips->oids[j]))) {
+                *out = 1;
+            } else {
+                error = git_graph_descendant_of(repository, &(tips->oids[j]), &oid);
+                if (error < 0)
+                    return error;
+                *out = error;
+            }
+        }
+    }
+
+    return GIT_OK;
+}
+
+/**
+ * Resolve the tips of a revision walk.
  *
  * @param repo S3 class git_repository
- * @param topological Sort the commits by topological order; Can be
- * combined with time.
- * @param time Sort the commits by commit time; can be combined with
- * topological.
- * @param reverse Sort the commits in reverse order
- * @return list with S3 class git_commit objects
+ * @param ref Character vector with the revisions to walk, see
+ * git2r_revwalk_spec, or R_NilValue to walk from HEAD.
+ * @param hide Character vector with the revisions to hide, or
+ * R_NilValue.
+ * @param known Character vector with the sha of commits to check if
+ * they are reachable from the tips, or R_NilValue.
+ * @return list with the character vectors 'ref' and 'hide' with the
+ * sha of the commits to walk from and to hide, and the logical
+ * 'reachable' that is TRUE if all commits in 'known' are one of the
+ * tips or an ancestor of one of them.
  */
 SEXP attribute_hidden
-git2r_revwalk_contributions(
+git2r_revwalk_tips(
     SEXP repo,
-    SEXP topological,
-    SEXP time,
-    SEXP reverse)
+    SEXP ref,
+    SEXP hide,
+    SEXP known)
 {
-    int error = GIT_OK, nprotect = 0;
-    SEXP result = R_NilValue;
-    SEXP names = R_NilValue;
-    SEXP when = R_NilValue;
-    SEXP author = R_NilValue;
-    SEXP email = R_NilValue;
-    size_t i, n = 0;
-    unsigned int sort_mode = GIT_SORT_NONE;
-    git_revwalk *walker = NULL;
+    int error = GIT_OK, nprotect = 0, reachable = 0;
+    size_t i;
+    SEXP result = R_NilValue, names, item;
+    git2r_oid_buf push_oids = {NULL, 0, 0};
+    git2r_oid_buf hide_oids = {NULL, 0, 0};
     git_repository *repository = NULL;
 
-    if (git2r_arg_check_logical(topological))
-        git2r_error(__func__, NULL, "'topological'", git2r_err_logical_arg);
-    if (git2r_arg_check_logical(time))
-        git2r_error(__func__, NULL, "'time'", git2r_err_logical_arg);
-    if (git2r_arg_check_logical(reverse))
-        git2r_error(__func__, NULL, "'reverse'", git2r_err_logical_arg);
+    if (!Rf_isNull(ref) && git2r_arg_check_string_vec(ref))
+        git2r_error(__func__, NULL, "'ref'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(hide) && git2r_arg_check_string_vec(hide))
+        git2r_error(__func__, NULL, "'hide'", git2r_err_string_vec_arg);
+    if (!Rf_isNull(known) && git2r_arg_check_string_vec(known))
+        git2r_error(__func__, NULL, "'known'", git2r_err_string_vec_arg);
 
     repository = git2r_repository_open(repo);
     if (!repository)
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
-    if (git_repository_is_empty(repository))
-        goto cleanup;
-
-    if (LOGICAL(topological)[0])
-        sort_mode |= GIT_SORT_TOPOLOGICAL;
-    if (LOGICAL(time)[0])
-        sort_mode |= GIT_SORT_TIME;
-    if (LOGICAL(reverse)[0])
-        sort_mode |= GIT_SORT_REVERSE;
-
-    error = git_revwalk_new(&walker, repository);
-    if (error)
-        goto cleanup;
-
-    error = git_revwalk_push_head(walker);
-    if (error)
-        goto cleanup;
-    git_revwalk_sorting(walker, sort_mode);
+    if (!git_repository_is_empty(repository)) {
+        error = git2r_revwalk_tips_resolve(&push_oids, &hide_oids,
+                                           repository, ref, hide);
+        if (error)
+            goto cleanup;
 
-    /* Count number of revisions before creating the list */
-    n = git2r_revwalk_count(walker, -1);
+        if (!Rf_isNull(known)) {
+            error = git2r_revwalk_tips_reachable(&reachable, repository,
+                                                 &push_oids, known);
+            if (error)
+                goto cleanup;
+        }
+    }
 
-    /* Create vectors to store result */
     PROTECT(result = Rf_allocVector(VECSXP, 3));
     nprotect++;
     Rf_setAttrib(result, R_NamesSymbol, names = Rf_allocVector(STRSXP, 3));
-    SET_VECTOR_ELT(result, 0, when = Rf_allocVector(REALSXP, n));
-    SET_STRING_ELT(names, 0, Rf_mkChar("when"));
-    SET_VECTOR_ELT(result, 1, author = Rf_allocVector(STRSXP, n));
-    SET_STRING_ELT(names, 1, Rf_mkChar("author"));
-    SET_VECTOR_ELT(result, 2, email = Rf_allocVector(STRSXP, n));
-    SET_STRING_ELT(names, 2, Rf_mkChar("email"));
-
-    git_revwalk_reset(walker);
-    error = git_revwalk_push_head(walker);
-    if (error)
-        goto cleanup;
-    git_revwalk_sorting(walker, sort_mode);
+    SET_STRING_ELT(names, 0, Rf_mkChar("ref"));
+    SET_STRING_ELT(names, 1, Rf_mkChar("hide"));
+    SET_STRING_ELT(names, 2, Rf_mkChar("reachable"));
 
-    for (i = 0; i < n; i++) {
-        git_commit *commit;
-        const git_signature *c_author;
-        git_oid oid;
+    SET_VECTOR_ELT(result, 0, item = Rf_allocVector(STRSXP, push_oids.n));
+    for (i = 0; i < push_oids.n; i++) {
+        char sha[GIT_OID_HEXSZ + 1];
 
-        error = git_revwalk_next(&oid, walker);
-        if (error) {
-            if (GIT_ITEROVER == error)
-                error = GIT_OK;
-            goto cleanup;
-        }
+        git_oid_tostr(sha, sizeof(sha), &(push_oids.oids[i]));
+        SET_STRING_ELT(item, i, Rf_mkChar(sha));
+    }
 
-        error = git_commit_lookup(&commit, repository, &oid);
-        if (error)
-            goto cleanup;
+    SET_VECTOR_ELT(result, 1, item = Rf_allocVector(STRSXP, hide_oids.n));
+    for (i = 0; i < hide_oids.n; i++) {
+        char sha[GIT_OID_HEXSZ + 1];
 
-        c_author = git_commit_author(commit);
-        REAL(when)[i] =
-            (double)(c_author->when.time) +
-            60.0 * (double)(c_author->when.offset);
-        SET_STRING_ELT(author, i, Rf_mkChar(c_author->name));
-        SET_STRING_ELT(author, i, Rf_mkChar(c_author->email));
-        git_commit_free(commit);
+        git_oid_tostr(sha, sizeof(sha), &(hide_oids.oids[i]));
+        SET_STRING_ELT(item, i, Rf_mkChar(sha));
     }
 
+    SET_VECTOR_ELT(result, 2, Rf_ScalarLogical(reachable));
+
 cleanup:
-    git_revwalk_free(walker);
-    git_repository_free(repository);
+    free(push_oids.oids);
+    free(hide_oids.oids);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -22,8 +22,11 @@
 #include <R.h>
 #include <Rinternals.h>
 
-SEXP git2r_revwalk_contributions(SEXP repo, SEXP topological, SEXP time, SEXP reverse);
-SEXP git2r_revwalk_list(SEXP repo, SEXP sha, SEXP topological, SEXP time, SEXP reverse, SEXP max_n);
-SEXP git2r_revwalk_list2(SEXP repo, SEXP sha, SEXP topological, SEXP time, SEXP reverse, SEXP max_n, SEXP path);
+SEXP git2r_revwalk_contributions(SEXP repo, SEXP breaks, SEXP by_author);
+SEXP git2r_revwalk_df(SEXP repo, SEXP ref, SEXP hide, SEXP filter, SEXP topological, SEXP time, SEXP reverse, SEXP max_n, SEXP columns, SEXP threads);
+SEXP git2r_revwalk_list(SEXP repo, SEXP ref, SEXP hide, SEXP filter, SEXP topological, SEXP time, SEXP reverse, SEXP max_n);
+SEXP git2r_revwalk_list2(SEXP repo, SEXP ref, SEXP hide, SEXP filter, SEXP topological, SEXP time, SEXP reverse, SEXP max_n, SEXP path, SEXP follow);
+SEXP git2r_revwalk_punch_card(SEXP repo);
+SEXP git2r_revwalk_tips(SEXP repo, SEXP ref, SEXP hide, SEXP known);
 
 #endif
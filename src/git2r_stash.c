@@ -63,7 +63,7 @@ git2r_stash_apply(
     error = git_stash_apply(repository, INTEGER(index)[0], NULL);
     if (error == GIT_ENOTFOUND)
         error = 0;
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
 
@@ -93,7 +93,7 @@ git2r_stash_drop(
         git2r_error(__func__, NULL, git2r_err_invalid_repository, NULL);
 
     error = git_stash_drop(repository, INTEGER(index)[0]);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
 
@@ -126,7 +126,7 @@ git2r_stash_pop(
     error = git_stash_pop(repository, INTEGER(index)[0], NULL);
     if (error == GIT_ENOTFOUND)
         error = 0;
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
 
@@ -249,7 +249,7 @@ git2r_stash_list(
     error = git_stash_foreach(repository, &git2r_stash_list_cb, &cb_data);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -337,7 +337,7 @@ git2r_stash_save(
 cleanup:
     git_commit_free(commit);
     git_signature_free(c_stasher);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
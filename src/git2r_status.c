@@ -445,7 +445,7 @@ git2r_status_list(
 
 cleanup:
     git_status_list_free(status_list);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -186,7 +186,7 @@ cleanup:
     git_tag_free(tag);
     git_signature_free(sig_tagger);
     git_object_free(target);
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -221,7 +221,7 @@ git2r_tag_delete(
 
     error = git_tag_delete(repository, CHAR(STRING_ELT(name, 0)));
 
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (error)
         git2r_error(__func__, git_error_last(), NULL, NULL);
@@ -371,7 +371,7 @@ git2r_tag_list(
     error = git_tag_foreach(repository, &git2r_tag_foreach_cb, &cb_data);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
 
     if (nprotect)
         UNPROTECT(nprotect);
@@ -0,0 +1,185 @@
+/*
+ *  git2r, R bindings to the libgit2 library.
+ *  Copyright (C) 2026 The git2r contributors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License, version 2,
+ *  as published by the Free Software Foundation.
+ *
+ *  git2r is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# ifdef GIT2R_HAVE_PTHREAD
+#  include <pthread.h>
+# endif
+# include <unistd.h>
+#endif
+
+#include <R_ext/Visibility.h>
+#include <git2.h>
+#include <stdlib.h>
+
+#include "git2r_thread.h"
+
+/**
+ * The maximum number of threads, whatever the number of cores.
+ */
+#define GIT2R_THREAD_MAX 64
+
+#ifdef _WIN32
+typedef struct {
+    void *(*fn)(void *);
+    void *arg;
+} git2r_thread_start;
+
+static DWORD WINAPI
+git2r_thread_proc(
+    LPVOID param)
+{
+    git2r_thread_start *start = param;
+
+    start->fn(start->arg);
+
+    return 0;
+}
+#endif
+
+/**
+ * Check if it is safe to use libgit2 from several threads.
+ *
+ * @return 1 if libgit2 was built with thread support, and git2r can
+ * create threads, else 0.
+ */
+int attribute_hidden
+git2r_thread_available(void)
+{
+#if defined(_WIN32) || defined(GIT2R_HAVE_PTHREAD)
+    return (git_libgit2_features() & GIT_FEATURE_THREADS) != 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * The number of threads to use for a number of work items.
+ *
+ * The requested number of threads is limited to the number of work
+ * items, and to the number of cores but at most GIT2R_THREAD_MAX,
+ * since each thread opens its own repository handle. One thread is
+ * used if libgit2 was built without thread support, or if git2r
+ * was built without pthreads.
+ *
+ * @param threads The requested number of threads.
+ * @param n The number of work items.
+ * @return The number of threads, at least 1.
+ */
+size_t attribute_hidden
+git2r_thread_count(
+    int threads,
+    size_t n)
+{
+    size_t max = GIT2R_THREAD_MAX;
+    long cores;
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    cores = (long)info.dwNumberOfProcessors;
+#else
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cores > 0 && (size_t)cores < max)
+        max = (size_t)cores;
+
+    if (threads < 2 || n < 2 || !git2r_thread_available())
+        return 1;
+    if ((size_t)threads < max)
+        max = (size_t)threads;
+    if (n < max)
+        max = n;
+
+    return max;
+}
+
+/**
+ * Run a function on each work item in its own thread, and wait for
+ * all threads to finish.
+ *
+ * The function must not call the R API. A work item is run in the
+ * calling thread if its thread cannot be created, and all work
+ * items are run in the calling thread if git2r was built without
+ * pthreads.
+ *
+ * @param fn The function to run with a pointer to a work item.
+ * @param items The array with the work items.
+ * @param n The number of work items.
+ * @param size The size of a work item.
+ */
+void attribute_hidden
+git2r_thread_run(
+    void *(*fn)(void *),
+    void *items,
+    size_t n,
+    size_t size)
+{
+    size_t i;
+    char *item = items;
+
+#ifdef _WIN32
+    HANDLE *threads = calloc(n, sizeof(HANDLE));
+    git2r_thread_start *start = calloc(n, sizeof(git2r_thread_start));
+
+    for (i = 0; i < n; i++) {
+        if (threads && start) {
+            start[i].fn = fn;
+            start[i].arg = item + i * size;
+            threads[i] = CreateThread(NULL, 0, git2r_thread_proc,
+                                      &start[i], 0, NULL);
+        }
+        if (!threads || !start || !threads[i])
+            fn(item + i * size);
+    }
+
+    for (i = 0; threads && start && i < n; i++) {
+        if (threads[i]) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+
+    free(threads);
+    free(start);
+#elif defined(GIT2R_HAVE_PTHREAD)
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    int *started = calloc(n, sizeof(int));
+
+    for (i = 0; i < n; i++) {
+        if (threads && started)
+            started[i] = !pthread_create(&threads[i], NULL, fn, item + i * size);
+        if (!threads || !started || !started[i])
+            fn(item + i * size);
+    }
+
+    for (i = 0; threads && started && i < n; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    free(started);
+#else
+    for (i = 0; i < n; i++)
+        fn(item + i * size);
+#endif
+}
@@ -232,7 +232,7 @@ git2r_tree_walk(
     error = git_tree_walk(tree_obj, 0, &git2r_tree_walk_cb, &cb_data);
 
 cleanup:
-    git_repository_free(repository);
+    git2r_repository_free(repository);
     git_tree_free(tree_obj);
 
     if (nprotect)
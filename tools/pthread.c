@@ -0,0 +1,15 @@
+#include <pthread.h>
+
+static void *run(void *arg)
+{
+    return arg;
+}
+
+int main(void)
+{
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, run, NULL))
+        return 1;
+    return pthread_join(thread, NULL);
+}